@@ -0,0 +1,156 @@
+/********************************************************************
+ * Name: alloc.c
+ * Author: rashaudteague
+ * License: GNU LGPL <http://www.gnu.org/licenses/>
+ * Description: Pluggable allocators and a bump-pointer arena
+ ********************************************************************/
+
+#include "xstdlib.h"
+
+#define ARENA_ALIGN 16
+#define _arena_round(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define _arena_data(b) ((char *)(b) + _arena_round(sizeof(arena_block)))
+
+static void *_system_alloc(size_t size, void *ctx) {
+	return malloc(size);
+}
+
+static void *_system_resize(void *p, size_t old_size, size_t new_size, void *ctx) {
+	return realloc(p, new_size);
+}
+
+static void _system_release(void *p, void *ctx) {
+	free(p);
+}
+
+static xallocator _xstdlib_allocator = { _system_alloc, _system_resize, _system_release, NULL };
+
+/**
+ * Replaces the allocator used wherever no allocator is passed in (NULL
+ * restores malloc). Set it before anything is allocated: memory is always
+ * released through the allocator that is current at that time.
+ */
+void xstdlib_set_allocator(const xallocator *a) {
+	static const xallocator system = { _system_alloc, _system_resize, _system_release, NULL };
+	_xstdlib_allocator = a != NULL ? *a : system;
+}
+
+void *xalloc(const xallocator *a, size_t size) {
+	if (a == NULL) a = &_xstdlib_allocator;
+	XSTATS_BYTES(size);
+	return a->alloc(size, a->ctx);
+}
+
+void *xalloc_zero(const xallocator *a, size_t n, size_t size) {
+	void *p;
+	if (size != 0 && n > (size_t)-1 / size) return NULL;
+	if ((p = xalloc(a, n * size)) != NULL) memset(p, 0, n * size);
+	return p;
+}
+
+void *xalloc_resize(const xallocator *a, void *p, size_t old_size, size_t new_size) {
+	if (a == NULL) a = &_xstdlib_allocator;
+	XSTATS_BYTES(new_size);
+	return a->resize(p, old_size, new_size, a->ctx);
+}
+
+void xalloc_free(const xallocator *a, void *p) {
+	if (p == NULL) return;
+	if (a == NULL) a = &_xstdlib_allocator;
+	a->release(p, a->ctx);
+}
+
+static void *_arena_xalloc(size_t size, void *ctx) {
+	return arena_alloc((arena *)ctx, size);
+}
+
+static void *_arena_xresize(void *p, size_t old_size, size_t new_size, void *ctx) {
+	arena *a = (arena *)ctx;
+	arena_block *b = a->head;
+	char *grown;
+
+	/* the newest allocation can grow in place */
+	if (p != NULL && b != NULL && (char *)p + _arena_round(old_size) == _arena_data(b) + b->used
+			&& (char *)p - _arena_data(b) + _arena_round(new_size) <= b->size) {
+		b->used = (char *)p - _arena_data(b) + _arena_round(new_size);
+		return p;
+	}
+	if ((grown = (char *)arena_alloc(a, new_size)) == NULL) return NULL;
+	if (p != NULL) memcpy(grown, p, old_size < new_size ? old_size : new_size);
+	return grown;
+}
+
+static void _arena_xrelease(void *p, void *ctx) {
+	/* arena memory only goes away with arena_reset() or arena_destroy() */
+}
+
+/**
+ * Creates an arena that grabs memory from malloc() in blocks of
+ * block_size (ARENA_BLOCK_SIZE when 0)
+ */
+arena *arena_init(size_t block_size) {
+	arena *a;
+	if ((a = (arena *)malloc(sizeof(arena))) == NULL) return NULL;
+	a->head = NULL;
+	a->block_size = block_size > 0 ? block_size : ARENA_BLOCK_SIZE;
+	a->allocator.alloc = _arena_xalloc;
+	a->allocator.resize = _arena_xresize;
+	a->allocator.release = _arena_xrelease;
+	a->allocator.ctx = a;
+	return a;
+}
+
+/**
+ * Returns size bytes aligned to 16, NULL if out of memory
+ */
+void *arena_alloc(arena *a, size_t size) {
+	arena_block *b = a->head;
+	size_t rounded = _arena_round(size), block_size;
+	void *p;
+
+	if (rounded < size) return NULL;
+	if (b == NULL || b->size - b->used < rounded) {
+		block_size = rounded > a->block_size ? rounded : a->block_size;
+		if ((b = (arena_block *)malloc(_arena_round(sizeof(arena_block)) + block_size)) == NULL) return NULL;
+		b->prev = a->head;
+		b->size = block_size;
+		b->used = 0;
+		a->head = b;
+	}
+	p = _arena_data(b) + b->used;
+	b->used += rounded;
+	return p;
+}
+
+arena_mark arena_get_mark(arena *a) {
+	arena_mark m;
+	m.block = a->head;
+	m.used = a->head != NULL ? a->head->used : 0;
+	return m;
+}
+
+/**
+ * Frees everything allocated after mark, or everything when mark is NULL.
+ * A full reset keeps the first block so the next round does not malloc().
+ */
+void arena_reset(arena *a, const arena_mark *mark) {
+	arena_block *b;
+	arena_block *keep = mark != NULL ? mark->block : NULL;
+
+	while ((b = a->head) != keep && b != NULL) {
+		if (keep == NULL && b->prev == NULL) break;
+		a->head = b->prev;
+		free(b);
+	}
+	if (a->head != NULL) a->head->used = keep != NULL ? mark->used : 0;
+}
+
+void arena_destroy(arena *a) {
+	arena_block *b, *prev;
+	if (a == NULL) return;
+	for (b = a->head; b != NULL; b = prev) {
+		prev = b->prev;
+		free(b);
+	}
+	free(a);
+}
@@ -0,0 +1,229 @@
+/********************************************************************
+ * Name: bench.c
+ * Author: rashaudteague
+ * License: GNU LGPL <http://www.gnu.org/licenses/>
+ * Description: Benchmark harness for the xstdlib modules
+ *
+ * usage: xbench [-s scale] [-r repeat] [-f filter] [-o out.json]
+ *               [-b baseline.json] [-t threshold%]
+ *
+ * Every case runs repeat times and the fastest run is reported. Results go
+ * out as JSON with one case per line; with a baseline, cases slower by more
+ * than threshold percent are reported and the exit status is 1.
+ ********************************************************************/
+
+#include "bench.h"
+
+volatile unsigned long long bench_sink = 0;
+
+/*
+ * Allocation counting. The bench binary is linked with --wrap for the
+ * allocator, so every malloc() made by the library objects lands here.
+ */
+static unsigned long long _bench_allocs = 0;
+static unsigned long long _bench_alloc_bytes = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+void *__wrap_malloc(size_t size) {
+	__atomic_fetch_add(&_bench_allocs, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&_bench_alloc_bytes, size, __ATOMIC_RELAXED);
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+	__atomic_fetch_add(&_bench_allocs, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&_bench_alloc_bytes, n * size, __ATOMIC_RELAXED);
+	return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size) {
+	__atomic_fetch_add(&_bench_allocs, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&_bench_alloc_bytes, size, __ATOMIC_RELAXED);
+	return __real_realloc(p, size);
+}
+
+void bench_start(bench_state *b) {
+	b->allocs_at_start = __atomic_load_n(&_bench_allocs, __ATOMIC_RELAXED);
+	b->alloc_bytes_at_start = __atomic_load_n(&_bench_alloc_bytes, __ATOMIC_RELAXED);
+	clock_gettime(CLOCK_MONOTONIC, &b->started);
+}
+
+void bench_stop(bench_state *b) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	b->ns += (now.tv_sec - b->started.tv_sec) * 1e9 + (now.tv_nsec - b->started.tv_nsec);
+	b->allocs += __atomic_load_n(&_bench_allocs, __ATOMIC_RELAXED) - b->allocs_at_start;
+	b->alloc_bytes += __atomic_load_n(&_bench_alloc_bytes, __ATOMIC_RELAXED) - b->alloc_bytes_at_start;
+}
+
+/**
+ * Generates newline separated access-log style lines totalling about bytes
+ */
+char *bench_log_text(size_t bytes, size_t *line_count) {
+	static const char *levels[] = { "INFO", "INFO", "INFO", "WARN", "ERROR", "DEBUG" };
+	static const char *paths[] = { "/api/v1/users", "/api/v1/orders", "/static/app.js", "/health", "/api/v2/search" };
+	char *text;
+	size_t len = 0, lines = 0;
+	int n;
+
+	if ((text = (char *)malloc(bytes + 512)) == NULL) return NULL;
+	srand(42);
+	while (len < bytes) {
+		n = sprintf(text + len, "2026-10-19 12:%02d:%02d %s [worker-%d] request id=%08x path=%s%s status=%d ms=%d\n",
+			rand() % 60, rand() % 60, levels[rand() % 6], rand() % 32, rand(), paths[rand() % 5],
+			rand() % 4 == 0 ? "?page=2&sort=desc" : "", rand() % 10 == 0 ? 500 : 200, rand() % 2000);
+		len += n;
+		lines++;
+	}
+	text[len] = '\0';
+	*line_count = lines;
+	return text;
+}
+
+/**
+ * Splits text in place at every newline
+ */
+char **bench_log_lines(char *text, size_t line_count) {
+	char **lines, *p = text;
+	size_t i;
+	if ((lines = (char **)malloc(line_count * sizeof(char *))) == NULL) return NULL;
+	for (i = 0; i < line_count; i++) {
+		lines[i] = p;
+		p = strchr(p, '\n');
+		*p++ = '\0';
+	}
+	return lines;
+}
+
+void bench_key(char *buffer, unsigned long i) {
+	sprintf(buffer, "user:%lu:session", i * 2654435761UL % 1000000007UL);
+}
+
+char *bench_tmpfile(char *buffer, const char *name) {
+	const char *dir = getenv("TMPDIR");
+	sprintf(buffer, "%s/xbench-%d-%s", dir != NULL ? dir : "/tmp", (int)getpid(), name);
+	return buffer;
+}
+
+int bench_write_file(const char *path, size_t bytes) {
+	size_t lines, written = 0, len, n;
+	char *text;
+	FILE *fp;
+
+	if ((text = bench_log_text(bytes < 16 * MB ? bytes : 16 * MB, &lines)) == NULL) return 0;
+	if ((fp = fopen(path, "w")) == NULL) { free(text); return 0; }
+	len = strlen(text);
+	while (written < bytes) {
+		n = bytes - written < len ? bytes - written : len;
+		if (fwrite(text, 1, n, fp) != n) break;
+		written += n;
+	}
+	fclose(fp);
+	free(text);
+	return written >= bytes;
+}
+
+typedef struct __bench_baseline__ {
+	char name[128];
+	double ns_per_op;
+} _bench_baseline;
+
+static int _bench_load_baseline(const char *path, _bench_baseline **out) {
+	FILE *fp;
+	char line[1024], *p;
+	int count = 0, size = 64;
+	_bench_baseline *b;
+
+	if ((fp = fopen(path, "r")) == NULL) return -1;
+	if ((b = (_bench_baseline *)malloc(size * sizeof(_bench_baseline))) == NULL) { fclose(fp); return -1; }
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (sscanf(line, " {\"name\": \"%127[^\"]\"", b[count].name) != 1) continue;
+		if ((p = strstr(line, "\"ns_per_op\": ")) == NULL) continue;
+		b[count].ns_per_op = strtod(p + 13, NULL);
+		if (++count == size) {
+			_bench_baseline *grown;
+			if ((grown = (_bench_baseline *)realloc(b, (size *= 2) * sizeof(_bench_baseline))) == NULL) break;
+			b = grown;
+		}
+	}
+	fclose(fp);
+	*out = b;
+	return count;
+}
+
+int main(int argc, char *argv[]) {
+	const bench_case *suites[] = { bench_strings, bench_hash, bench_lists, bench_file, bench_numbers, bench_os, NULL };
+	const bench_case *c;
+	const char *filter = NULL, *out_path = NULL, *baseline_path = NULL;
+	unsigned long scale = 1;
+	int repeat = 3, i, j, k, opt, first = 1, regressions = 0, baseline_count = 0;
+	double threshold = 10.0, ns_per_op, mb_per_s, change;
+	_bench_baseline *baseline = NULL;
+	bench_state best, b;
+	FILE *out = stdout;
+
+	while ((opt = getopt(argc, argv, "s:r:f:o:b:t:")) != -1) {
+		switch (opt) {
+			case 's': scale = strtoul(optarg, NULL, 10); break;
+			case 'r': repeat = atoi(optarg); break;
+			case 'f': filter = optarg; break;
+			case 'o': out_path = optarg; break;
+			case 'b': baseline_path = optarg; break;
+			case 't': threshold = atof(optarg); break;
+			default:
+				fprintf(stderr, "usage: %s [-s scale] [-r repeat] [-f filter] [-o out.json] [-b baseline.json] [-t threshold%%]\n", argv[0]);
+				return 2;
+		}
+	}
+	if (scale == 0) scale = 1;
+	if (repeat <= 0) repeat = 1;
+
+	if (baseline_path != NULL && (baseline_count = _bench_load_baseline(baseline_path, &baseline)) == -1) {
+		fprintf(stderr, "xbench: cannot read baseline %s\n", baseline_path);
+		return 2;
+	}
+	if (out_path != NULL && (out = fopen(out_path, "w")) == NULL) {
+		fprintf(stderr, "xbench: cannot write %s\n", out_path);
+		return 2;
+	}
+
+	fprintf(out, "{\n\"version\": %d,\n\"scale\": %lu,\n\"results\": [\n", XSTDLIB_VERSION, scale);
+	for (i = 0; suites[i] != NULL; i++) {
+		for (c = suites[i]; c->name != NULL; c++) {
+			if (filter != NULL && strstr(c->name, filter) == NULL) continue;
+			memset(&best, 0, sizeof(best));
+			for (j = 0; j < repeat; j++) {
+				memset(&b, 0, sizeof(b));
+				b.scale = scale;
+				c->run(&b);
+				if (j == 0 || b.ns < best.ns) best = b;
+			}
+
+			ns_per_op = best.ops > 0 ? best.ns / best.ops : best.ns;
+			mb_per_s = best.bytes > 0 && best.ns > 0 ? best.bytes / (best.ns / 1e9) / MB : 0;
+			fprintf(out, "%s  {\"name\": \"%s\", \"ops\": %llu, \"ns_per_op\": %.2f, \"mb_per_s\": %.2f, \"allocs\": %llu, \"alloc_bytes\": %llu}",
+				first ? "" : ",\n", c->name, best.ops, ns_per_op, mb_per_s, best.allocs, best.alloc_bytes);
+			fflush(out);
+			first = 0;
+			if (out != stdout) fprintf(stderr, "%-32s %12.2f ns/op %10.2f MB/s %10llu allocs\n", c->name, ns_per_op, mb_per_s, best.allocs);
+
+			for (k = 0; k < baseline_count; k++) {
+				if (strcmp(baseline[k].name, c->name) != 0 || baseline[k].ns_per_op <= 0) continue;
+				change = (ns_per_op - baseline[k].ns_per_op) / baseline[k].ns_per_op * 100;
+				if (change > threshold) {
+					fprintf(stderr, "REGRESSION %s: %.2f -> %.2f ns/op (+%.1f%%)\n", c->name, baseline[k].ns_per_op, ns_per_op, change);
+					regressions++;
+				}
+			}
+		}
+	}
+	fprintf(out, "\n]\n}\n");
+
+	if (out != stdout) fclose(out);
+	free(baseline);
+
+	return regressions > 0;
+}
@@ -0,0 +1,60 @@
+/********************************************************************
+ * Name: bench.h
+ * Author: rashaudteague
+ * License: GNU LGPL <http://www.gnu.org/licenses/>
+ * Description: Benchmark harness for the xstdlib modules
+ ********************************************************************/
+
+#ifndef XSTDLIB_BENCH_H_
+#define XSTDLIB_BENCH_H_
+
+#include "../xstdlib.h"
+
+/*
+ * Data set sizes at scale 1, everything grows linearly with the scale:
+ *   strings  16 MB of log lines
+ *   hash     25k keys in the fixed HASHSIZE buckets (1M at -s 40)
+ *   lists    1M elements (10M at -s 10)
+ *   file     64 MB file for line reading, 1 MB for the byte-at-a-time copy()
+ *   numbers  1M values per kernel
+ */
+
+typedef struct __bench_state__ {
+	unsigned long scale;
+	unsigned long long ops;      /* set by the benchmark */
+	unsigned long long bytes;    /* set by the benchmark when throughput matters */
+	/* filled by the harness */
+	double ns;
+	unsigned long long allocs;
+	unsigned long long alloc_bytes;
+	struct timespec started;
+	unsigned long long allocs_at_start;
+	unsigned long long alloc_bytes_at_start;
+} bench_state;
+
+typedef struct __bench_case__ {
+	const char *name;
+	void (*run)(bench_state *b);
+} bench_case;
+
+void bench_start(bench_state *b);
+void bench_stop(bench_state *b);
+
+/* shared data sets */
+char *bench_log_text(size_t bytes, size_t *line_count);
+char **bench_log_lines(char *text, size_t line_count);
+void bench_key(char *buffer, unsigned long i);
+char *bench_tmpfile(char *buffer, const char *name);
+int bench_write_file(const char *path, size_t bytes);
+
+extern volatile unsigned long long bench_sink;
+
+/* one NULL terminated table per module */
+extern const bench_case bench_strings[];
+extern const bench_case bench_hash[];
+extern const bench_case bench_lists[];
+extern const bench_case bench_file[];
+extern const bench_case bench_numbers[];
+extern const bench_case bench_os[];
+
+#endif
@@ -0,0 +1,169 @@
+/********************************************************************
+ * Name: bench_file.c
+ * Author: rashaudteague
+ * License: GNU LGPL <http://www.gnu.org/licenses/>
+ * Description: file.c benchmarks over generated log files
+ ********************************************************************/
+
+#include "bench.h"
+
+static int _bench_count_line(const char *line, size_t len, void *arg) {
+	(*(unsigned long long *)arg) += len;
+	return 0;
+}
+
+static void _bench_file_foreach_line(bench_state *b) {
+	char path[PATH_MAX];
+	unsigned long long bytes = 0;
+	long long lines;
+	if (!bench_write_file(bench_tmpfile(path, "lines"), 64 * MB * b->scale)) return;
+	bench_start(b);
+	lines = file_foreach_line(path, _bench_count_line, &bytes);
+	bench_stop(b);
+	b->ops = lines > 0 ? lines : 0;
+	b->bytes = filesize(path);
+	bench_sink += bytes;
+	unlink(path);
+}
+
+static void _bench_file(bench_state *b) {
+	char path[PATH_MAX], **elements;
+	unsigned long long bytes = 0;
+	long long lines;
+	int n;
+	if (!bench_write_file(bench_tmpfile(path, "file"), 16 * MB * b->scale)) return;
+	if ((lines = file_foreach_line(path, _bench_count_line, &bytes)) < 0) { unlink(path); return; }
+	if ((elements = (char **)malloc((lines + 1) * sizeof(char *))) == NULL) { unlink(path); return; }
+	bench_start(b);
+	n = file(path, elements, FILE_IGNORE_NEW_LINES);
+	bench_stop(b);
+	b->ops = n > 0 ? n : 0;
+	b->bytes = filesize(path);
+	if (n > 0) file_free(elements, n);
+	free(elements);
+	unlink(path);
+}
+
+static void _bench_readfile(bench_state *b) {
+	char path[PATH_MAX];
+	FILE *null;
+	if (!bench_write_file(bench_tmpfile(path, "readfile"), 64 * MB * b->scale)) return;
+	if ((null = fopen("/dev/null", "w")) == NULL) { unlink(path); return; }
+	bench_start(b);
+	bench_sink += readfile(path, null);
+	bench_stop(b);
+	b->ops = 1;
+	b->bytes = filesize(path);
+	fclose(null);
+	unlink(path);
+}
+
+static void _bench_copy(bench_state *b) {
+	char source[PATH_MAX], dest[PATH_MAX];
+	if (!bench_write_file(bench_tmpfile(source, "copy-src"), MB * b->scale)) return;
+	bench_tmpfile(dest, "copy-dest");
+	bench_start(b);
+	bench_sink += copy(source, dest);
+	bench_stop(b);
+	b->ops = 1;
+	b->bytes = filesize(source);
+	unlink(source);
+	unlink(dest);
+}
+
+static int _bench_count_fields(const csv_field *fields, size_t count, void *arg) {
+	(*(unsigned long long *)arg) += count;
+	return 0;
+}
+
+static void _bench_csv_feed(bench_state *b) {
+	size_t bytes = 64 * MB * b->scale, len = 0, at, n;
+	unsigned long long fields = 0;
+	csv_parser *p;
+	char *text;
+
+	if ((text = (char *)malloc(bytes + 256)) == NULL) return;
+	srand(42);
+	while (len < bytes)
+		len += sprintf(text + len, "%d,%08x,\"/api/v1/orders?id=%d,%d\",%s,\"said \"\"hi\"\"\",%d.%02d\n",
+			rand() % 100000, rand(), rand() % 1000, rand() % 10, rand() % 2 ? "ok" : "error", rand() % 500, rand() % 100);
+	if ((p = csv_init(',', '"', '"', _bench_count_fields, &fields)) == NULL) { free(text); return; }
+	bench_start(b);
+	for (at = 0; at < len; at += n) {
+		n = len - at < MB ? len - at : MB;
+		csv_feed(p, text + at, n);
+	}
+	csv_finish(p);
+	bench_stop(b);
+	b->ops = p->records;
+	b->bytes = len;
+	bench_sink += fields;
+	csv_destroy(p);
+	free(text);
+}
+
+#ifdef __linux__
+/**
+ * Queries a tree of 64 directories of 16 files, appending to one file
+ * before every query so each one has an event to apply
+ */
+static void _bench_dirsize_get(bench_state *b) {
+	char root[PATH_MAX], path[PATH_MAX + 16];
+	long long i, ops = 20000 * b->scale;
+	dirsize *d;
+	FILE *f;
+	int j, k;
+
+	if (mkdir(bench_tmpfile(root, "dirsize"), 0755) != 0) return;
+	for (j = 0; j < 64; j++) {
+		snprintf(path, sizeof(path), "%s/%02d", root, j);
+		mkdir(path, 0755);
+		for (k = 0; k < 16; k++) {
+			snprintf(path, sizeof(path), "%s/%02d/%02d", root, j, k);
+			if ((f = fopen(path, "w")) != NULL) { fputs("x", f); fclose(f); }
+		}
+	}
+	if ((d = dirsize_open(root)) != NULL) {
+		/* a new directory and a write elsewhere in one burst of events */
+		snprintf(path, sizeof(path), "%s/new", root);
+		mkdir(path, 0755);
+		snprintf(path, sizeof(path), "%s/01/00", root);
+		if ((f = fopen(path, "a")) != NULL) { fputs("burst", f); fclose(f); }
+		snprintf(path, sizeof(path), "%s/01", root);
+		if (dirsize_get(d, "01") != filesize(path) || dirsize_get(d, NULL) != filesize(root))
+			fprintf(stderr, "xbench: dirsize_get out of step with filesize\n");
+		snprintf(path, sizeof(path), "%s/new", root);
+		rmdir(path);
+		bench_start(b);
+		for (i = 0; i < ops; i++) {
+			snprintf(path, sizeof(path), "%s/%02d/%02d", root, (int)(i % 64), (int)(i / 64 % 16));
+			if ((f = fopen(path, "a")) != NULL) { fputc('x', f); fclose(f); }
+			bench_sink += dirsize_get(d, NULL);
+		}
+		bench_stop(b);
+		b->ops = ops;
+		dirsize_close(d);
+	}
+	for (j = 0; j < 64; j++) {
+		for (k = 0; k < 16; k++) {
+			snprintf(path, sizeof(path), "%s/%02d/%02d", root, j, k);
+			unlink(path);
+		}
+		snprintf(path, sizeof(path), "%s/%02d", root, j);
+		rmdir(path);
+	}
+	rmdir(root);
+}
+#endif
+
+const bench_case bench_file[] = {
+	{ "file/file_foreach_line", _bench_file_foreach_line },
+	{ "file/file", _bench_file },
+	{ "file/readfile", _bench_readfile },
+	{ "file/copy", _bench_copy },
+	{ "file/csv_feed", _bench_csv_feed },
+#ifdef __linux__
+	{ "file/dirsize_get", _bench_dirsize_get },
+#endif
+	{ NULL, NULL },
+};
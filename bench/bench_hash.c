@@ -0,0 +1,176 @@
+/********************************************************************
+ * Name: bench_hash.c
+ * Author: rashaudteague
+ * License: GNU LGPL <http://www.gnu.org/licenses/>
+ * Description: hash.c benchmarks over session-style string keys
+ ********************************************************************/
+
+#include "bench.h"
+
+typedef struct __bench_keys__ {
+	char (*keys)[32];
+	unsigned long count;
+} _bench_keys;
+
+static int _bench_keys_init(_bench_keys *k, unsigned long count, unsigned long offset) {
+	unsigned long i;
+	if ((k->keys = malloc(count * sizeof(*k->keys))) == NULL) return 0;
+	for (i = 0; i < count; i++) bench_key(k->keys[i], i + offset);
+	k->count = count;
+	return 1;
+}
+
+static void _bench_table_fill(hashtab *h[], _bench_keys *k) {
+	unsigned long i;
+	hash_init(h);
+	for (i = 0; i < k->count; i++) hash_set(h, k->keys[i], NULL, VOID, NULL, NULL);
+}
+
+static void _bench_hash(bench_state *b) {
+	_bench_keys k;
+	unsigned long i;
+	if (!_bench_keys_init(&k, 1000000 * b->scale, 0)) return;
+	bench_start(b);
+	for (i = 0; i < k.count; i++) bench_sink += hash(k.keys[i]);
+	bench_stop(b);
+	b->ops = k.count;
+	free(k.keys);
+}
+
+static void _bench_hash_set(bench_state *b) {
+	hashtab *h[HASHSIZE];
+	_bench_keys k;
+	if (!_bench_keys_init(&k, 25000 * b->scale, 0)) return;
+	bench_start(b);
+	_bench_table_fill(h, &k);
+	bench_stop(b);
+	b->ops = k.count;
+	hash_destroy(h, HASHSIZE);
+	free(k.keys);
+}
+
+static void _bench_hash_get(bench_state *b, int hits) {
+	hashtab *h[HASHSIZE];
+	_bench_keys k, probe;
+	unsigned long i;
+	if (!_bench_keys_init(&k, 25000 * b->scale, 0)) return;
+	if (!_bench_keys_init(&probe, k.count, hits ? 0 : k.count)) { free(k.keys); return; }
+	_bench_table_fill(h, &k);
+	bench_start(b);
+	for (i = 0; i < probe.count; i++) bench_sink += hash_get(h, probe.keys[i]) != NULL;
+	bench_stop(b);
+	b->ops = probe.count;
+	hash_destroy(h, HASHSIZE);
+	free(probe.keys);
+	free(k.keys);
+}
+
+static void _bench_hash_get_hit(bench_state *b) {
+	_bench_hash_get(b, 1);
+}
+
+static void _bench_hash_get_miss(bench_state *b) {
+	_bench_hash_get(b, 0);
+}
+
+/**
+ * Scattered hits on a table far bigger than the cache, one lookup at a
+ * time or all of them through hash_get_many()
+ */
+static void _bench_hash_get_large(bench_state *b, int many) {
+	hashtab *h[HASHSIZE], **out;
+	const char **probe;
+	_bench_keys k;
+	unsigned long i, n = 20000 * b->scale;
+	if (!_bench_keys_init(&k, 200000 * b->scale, 0)) return;
+	if ((probe = (const char **)malloc(n * sizeof(char *))) == NULL) { free(k.keys); return; }
+	if ((out = (hashtab **)malloc(n * sizeof(hashtab *))) == NULL) { free(probe); free(k.keys); return; }
+	for (i = 0; i < n; i++) probe[i] = k.keys[i * 2654435761UL % k.count];
+	_bench_table_fill(h, &k);
+	bench_start(b);
+	if (many) {
+		bench_sink += hash_get_many(h, probe, n, out);
+	} else {
+		for (i = 0; i < n; i++) bench_sink += (out[i] = hash_get(h, probe[i])) != NULL;
+	}
+	bench_stop(b);
+	b->ops = n;
+	hash_destroy(h, HASHSIZE);
+	free(out);
+	free(probe);
+	free(k.keys);
+}
+
+static void _bench_hash_get_loop(bench_state *b) {
+	_bench_hash_get_large(b, 0);
+}
+
+static void _bench_hash_get_many(bench_state *b) {
+	_bench_hash_get_large(b, 1);
+}
+
+HASH_DEFINE_UINT64(_bench_ids, unsigned long)
+
+static void _bench_int64_get(bench_state *b) {
+	_bench_ids ids;
+	unsigned long i, n = 25000 * b->scale;
+	if (!_bench_ids_init(&ids, n)) return;
+	for (i = 0; i < n; i++) _bench_ids_set(&ids, i * 2654435761UL % 1000000007UL, i);
+	bench_start(b);
+	for (i = 0; i < n; i++) bench_sink += *_bench_ids_get(&ids, i * 2654435761UL % 1000000007UL);
+	bench_stop(b);
+	b->ops = n;
+	_bench_ids_destroy(&ids);
+}
+
+static void _bench_hash_get_miss_filtered(bench_state *b) {
+	hashtab *h[HASHSIZE];
+	_bench_keys k, probe;
+	unsigned long i;
+	bloom *f;
+	if (!_bench_keys_init(&k, 25000 * b->scale, 0)) return;
+	if (!_bench_keys_init(&probe, k.count, k.count)) { free(k.keys); return; }
+	_bench_table_fill(h, &k);
+	if ((f = hash_bloom(h, HASHSIZE, 0.01)) == NULL) { hash_destroy(h, HASHSIZE); free(probe.keys); free(k.keys); return; }
+	bench_start(b);
+	for (i = 0; i < probe.count; i++) bench_sink += hash_get_filtered(f, h, probe.keys[i]) != NULL;
+	bench_stop(b);
+	b->ops = probe.count;
+	bloom_destroy(f);
+	hash_destroy(h, HASHSIZE);
+	free(probe.keys);
+	free(k.keys);
+}
+
+static void _bench_cache_get(bench_state *b) {
+	hash_cache *c;
+	_bench_keys k;
+	unsigned long i, j;
+	if (!_bench_keys_init(&k, 25000 * b->scale, 0)) return;
+	/* room for three quarters of the keys, so the scattered probes mix hits with evicting misses */
+	if ((c = hash_cache_init(k.count / 4 * 3, 0)) == NULL) { free(k.keys); return; }
+	for (i = 0; i < k.count; i++) hash_cache_set(c, k.keys[i], NULL, VOID, NULL, 0, 0);
+	bench_start(b);
+	for (i = 0; i < k.count; i++) {
+		j = i * 2654435761UL % k.count;
+		if (hash_cache_get(c, k.keys[j]) == NULL) hash_cache_set(c, k.keys[j], NULL, VOID, NULL, 0, 0);
+	}
+	bench_stop(b);
+	b->ops = k.count;
+	bench_sink += c->hits + c->evictions;
+	hash_cache_destroy(c);
+	free(k.keys);
+}
+
+const bench_case bench_hash[] = {
+	{ "hash/hash", _bench_hash },
+	{ "hash/hash_set", _bench_hash_set },
+	{ "hash/hash_get_hit", _bench_hash_get_hit },
+	{ "hash/hash_get_miss", _bench_hash_get_miss },
+	{ "hash/hash_get_miss_filtered", _bench_hash_get_miss_filtered },
+	{ "hash/hash_get_loop", _bench_hash_get_loop },
+	{ "hash/hash_get_many", _bench_hash_get_many },
+	{ "hash/int64_get", _bench_int64_get },
+	{ "hash/cache_get", _bench_cache_get },
+	{ NULL, NULL },
+};
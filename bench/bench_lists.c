@@ -0,0 +1,229 @@
+/********************************************************************
+ * Name: bench_lists.c
+ * Author: rashaudteague
+ * License: GNU LGPL <http://www.gnu.org/licenses/>
+ * Description: lists.c and vector.c benchmarks
+ ********************************************************************/
+
+#include "bench.h"
+
+static int _bench_values[1024];
+
+static void _bench_list_push_back(bench_state *b) {
+	list *l;
+	unsigned long i, n = 1000000 * b->scale;
+	if ((l = list_init()) == NULL) return;
+	bench_start(b);
+	for (i = 0; i < n; i++) list_push_back(l, &_bench_values[i & 1023], INT, NONDYNAMIC);
+	bench_stop(b);
+	b->ops = n;
+	list_destroy(l);
+}
+
+static void _bench_list_iterate(bench_state *b) {
+	list *l;
+	list_element *e;
+	unsigned long i, n = 1000000 * b->scale;
+	long long sum = 0;
+	if ((l = list_init()) == NULL) return;
+	for (i = 0; i < n; i++) list_push_back(l, &_bench_values[i & 1023], INT, NONDYNAMIC);
+	list_rewind(l);
+	bench_start(b);
+	while ((e = list_current(l)) != NULL) sum += *(int *)e->data;
+	bench_stop(b);
+	bench_sink += sum;
+	b->ops = n;
+	list_destroy(l);
+}
+
+static void _bench_list_destroy(bench_state *b) {
+	list *l;
+	unsigned long i, n = 1000000 * b->scale;
+	if ((l = list_init()) == NULL) return;
+	for (i = 0; i < n; i++) list_push_back(l, &_bench_values[i & 1023], INT, NONDYNAMIC);
+	bench_start(b);
+	list_destroy(l);
+	bench_stop(b);
+	b->ops = n;
+}
+
+static void _bench_list_random_fill(bench_state *b) {
+	list *l;
+	unsigned long n = 1000000 * b->scale;
+	if ((l = list_init()) == NULL) return;
+	bench_start(b);
+	list_random_fill(l, n);
+	bench_stop(b);
+	b->ops = n;
+	list_destroy(l);
+}
+
+static void _bench_vector_push_back(bench_state *b) {
+	vector *v;
+	unsigned long i, n = 1000000 * b->scale;
+	if ((v = vector_init(INT, NONDYNAMIC)) == NULL) return;
+	bench_start(b);
+	for (i = 0; i < n; i++) vector_push_back(v, &_bench_values[i & 1023]);
+	bench_stop(b);
+	b->ops = n;
+	vector_destroy(v);
+}
+
+static void _bench_vector_reduce(bench_state *b) {
+	vector *v;
+	double *values;
+	long double sum = 0;
+	unsigned long i, n = 1000000 * b->scale;
+	if ((values = (double *)malloc(n * sizeof(double))) == NULL) return;
+	if ((v = vector_init(DOUBLE, NONDYNAMIC)) == NULL) { free(values); return; }
+	for (i = 0; i < n; i++) {
+		values[i] = (double)(i & 1023) / 8;
+		vector_push_back(v, &values[i]);
+	}
+	bench_start(b);
+	vector_reduce(v, VECTOR_SUM, &sum);
+	bench_stop(b);
+	bench_sink += (unsigned long long)sum;
+	b->ops = n;
+	vector_destroy(v);
+	free(values);
+}
+
+VECTOR_DEFINE_NUMERIC(_bench_ints, int, long long)
+
+static void _bench_typed_vector_push(bench_state *b) {
+	_bench_ints v;
+	unsigned long i, n = 1000000 * b->scale;
+	if (!_bench_ints_init(&v, 0)) return;
+	bench_start(b);
+	for (i = 0; i < n; i++) _bench_ints_push(&v, _bench_values[i & 1023]);
+	bench_stop(b);
+	b->ops = n;
+	_bench_ints_destroy(&v);
+}
+
+static void _bench_typed_vector_sum(bench_state *b) {
+	_bench_ints v;
+	unsigned long n = 1000000 * b->scale;
+	if (!_bench_ints_init(&v, n)) return;
+	_bench_ints_fill(&v, n, 3);
+	bench_start(b);
+	bench_sink += _bench_ints_sum(&v);
+	bench_stop(b);
+	b->ops = n;
+	_bench_ints_destroy(&v);
+}
+
+static void _bench_deque_push_pop(bench_state *b) {
+	deque *d;
+	unsigned long i, n = 1000000 * b->scale;
+	long long sum = 0;
+	if ((d = deque_init(0)) == NULL) return;
+	bench_start(b);
+	for (i = 0; i < n; i++) {
+		deque_push_back(d, &_bench_values[i & 1023], INT, NONDYNAMIC);
+		if (i & 1) sum += *(int *)deque_pop_front(d);
+	}
+	while (deque_size(d) > 0) sum += *(int *)deque_pop_back(d);
+	bench_stop(b);
+	bench_sink += sum;
+	b->ops = n;
+	deque_destroy(d);
+}
+
+static int _bench_compare_int(const void *a, const void *b) {
+	return *(const int *)a < *(const int *)b ? -1 : *(const int *)a > *(const int *)b;
+}
+
+static void _bench_heap_push_pop(bench_state *b) {
+	static int keys[1024];
+	heap *h;
+	unsigned long i, n = 1000000 * b->scale;
+	long long sum = 0;
+	for (i = 0; i < 1024; i++) keys[i] = (int)(i * 2654435761UL % 1000003);
+	if ((h = heap_init(0, _bench_compare_int)) == NULL) return;
+	bench_start(b);
+	for (i = 0; i < n; i++) heap_push(h, &keys[i & 1023], INT, NONDYNAMIC);
+	while (heap_size(h) > 0) sum += *(int *)heap_pop(h);
+	bench_stop(b);
+	bench_sink += sum;
+	b->ops = n;
+	heap_destroy(h);
+}
+
+#define BENCH_QUEUE_BATCH 32
+
+typedef struct __bench_queue_job__ {
+	spsc_queue *spsc;
+	mpmc_queue *mpmc;
+	size_t n;
+} bench_queue_job;
+
+static void *_bench_spsc_producer(void *arg) {
+	bench_queue_job *job = (bench_queue_job *)arg;
+	void *items[BENCH_QUEUE_BATCH];
+	size_t i, done;
+	for (i = 0; i < BENCH_QUEUE_BATCH; i++) items[i] = &_bench_values[i];
+	for (i = 0; i < job->n; i += done) {
+		done = spsc_push_n(job->spsc, items, job->n - i < BENCH_QUEUE_BATCH ? job->n - i : BENCH_QUEUE_BATCH);
+		if (done == 0) sched_yield();
+	}
+	return NULL;
+}
+
+static void _bench_spsc_handoff(bench_state *b) {
+	bench_queue_job job = { NULL, NULL, 10000000 * b->scale };
+	pthread_t producer;
+	void *items[BENCH_QUEUE_BATCH];
+	size_t i, done;
+	if ((job.spsc = spsc_init(4096)) == NULL) return;
+	bench_start(b);
+	if (pthread_create(&producer, NULL, _bench_spsc_producer, &job) != 0) { spsc_destroy(job.spsc); return; }
+	for (i = 0; i < job.n; i += done) {
+		if ((done = spsc_pop_n(job.spsc, items, BENCH_QUEUE_BATCH)) == 0) sched_yield();
+		else bench_sink += *(int *)items[0];
+	}
+	pthread_join(producer, NULL);
+	bench_stop(b);
+	b->ops = job.n;
+	spsc_destroy(job.spsc);
+}
+
+static void *_bench_mpmc_producer(void *arg) {
+	bench_queue_job *job = (bench_queue_job *)arg;
+	size_t i;
+	for (i = 0; i < job->n; i++) mpmc_push_wait(job->mpmc, &_bench_values[i & 1023]);
+	return NULL;
+}
+
+static void _bench_mpmc_handoff(bench_state *b) {
+	bench_queue_job job = { NULL, NULL, 1000000 * b->scale };
+	pthread_t producers[2];
+	size_t i;
+	int started;
+	if ((job.mpmc = mpmc_init(4096)) == NULL) return;
+	bench_start(b);
+	for (started = 0; started < 2; started++)
+		if (pthread_create(&producers[started], NULL, _bench_mpmc_producer, &job) != 0) break;
+	for (i = 0; i < job.n * started; i++) bench_sink += *(int *)mpmc_pop_wait(job.mpmc);
+	while (started-- > 0) pthread_join(producers[started], NULL);
+	bench_stop(b);
+	b->ops = i;
+	mpmc_destroy(job.mpmc);
+}
+
+const bench_case bench_lists[] = {
+	{ "lists/list_push_back", _bench_list_push_back },
+	{ "lists/list_iterate", _bench_list_iterate },
+	{ "lists/list_destroy", _bench_list_destroy },
+	{ "lists/list_random_fill", _bench_list_random_fill },
+	{ "lists/vector_push_back", _bench_vector_push_back },
+	{ "lists/vector_reduce", _bench_vector_reduce },
+	{ "lists/typed_vector_push", _bench_typed_vector_push },
+	{ "lists/typed_vector_sum", _bench_typed_vector_sum },
+	{ "lists/deque_push_pop", _bench_deque_push_pop },
+	{ "lists/heap_push_pop", _bench_heap_push_pop },
+	{ "lists/spsc_handoff", _bench_spsc_handoff },
+	{ "lists/mpmc_handoff", _bench_mpmc_handoff },
+	{ NULL, NULL },
+};
@@ -0,0 +1,119 @@
+/********************************************************************
+ * Name: bench_numbers.c
+ * Author: rashaudteague
+ * License: GNU LGPL <http://www.gnu.org/licenses/>
+ * Description: numbers.c benchmarks
+ ********************************************************************/
+
+#include "bench.h"
+
+static unsigned long long *_bench_integers(unsigned long n) {
+	unsigned long long *a, x = 88172645463325252ULL;
+	unsigned long i;
+	if ((a = (unsigned long long *)malloc(n * sizeof(unsigned long long))) == NULL) return NULL;
+	for (i = 0; i < n; i++) {
+		/* xorshift64 */
+		x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+		a[i] = x;
+	}
+	return a;
+}
+
+static void _bench_dec2hex_array(bench_state *b) {
+	unsigned long n = 1000000 * b->scale;
+	unsigned long long *a;
+	char *text;
+	if ((a = _bench_integers(n)) == NULL) return;
+	if ((text = (char *)malloc(n * 16)) == NULL) { free(a); return; }
+	bench_start(b);
+	bench_sink += dec2hex_array(a, n, 16, text);
+	bench_stop(b);
+	b->ops = n;
+	b->bytes = n * 16;
+	free(text);
+	free(a);
+}
+
+static void _bench_hex2dec_array(bench_state *b) {
+	unsigned long n = 1000000 * b->scale;
+	unsigned long long *a;
+	char *text;
+	if ((a = _bench_integers(n)) == NULL) return;
+	if ((text = (char *)malloc(n * 16)) == NULL) { free(a); return; }
+	dec2hex_array(a, n, 16, text);
+	bench_start(b);
+	bench_sink += hex2dec_array(text, n, 16, a);
+	bench_stop(b);
+	b->ops = n;
+	b->bytes = n * 16;
+	free(text);
+	free(a);
+}
+
+static void _bench_dec2bin_array(bench_state *b) {
+	unsigned long n = 1000000 * b->scale;
+	unsigned long long *a;
+	char *text;
+	if ((a = _bench_integers(n)) == NULL) return;
+	if ((text = (char *)malloc(n * 32)) == NULL) { free(a); return; }
+	bench_start(b);
+	bench_sink += dec2bin_array(a, n, 32, text);
+	bench_stop(b);
+	b->ops = n;
+	b->bytes = n * 32;
+	free(text);
+	free(a);
+}
+
+static void _bench_xround_array_d(bench_state *b) {
+	unsigned long i, n = 1000000 * b->scale;
+	unsigned long long *bits;
+	double *a;
+	if ((bits = _bench_integers(n)) == NULL) return;
+	a = (double *)bits;
+	for (i = 0; i < n; i++) a[i] = (double)(bits[i] >> 11) / 1e9;
+	bench_start(b);
+	xround_array_d(a, n, 2, XROUND_HALF_EVEN);
+	bench_stop(b);
+	bench_sink += (unsigned long long)a[0];
+	b->ops = n;
+	b->bytes = n * sizeof(double);
+	free(a);
+}
+
+static void _bench_xround(bench_state *b) {
+	unsigned long i, n = 1000000 * b->scale;
+	float sum = 0;
+	bench_start(b);
+	for (i = 0; i < n; i++) sum += xround(i * 0.001f, 2);
+	bench_stop(b);
+	bench_sink += (unsigned long long)sum;
+	b->ops = n;
+}
+
+static void _bench_rational_reduce_array(bench_state *b) {
+	unsigned long i, n = 1000000 * b->scale;
+	unsigned long long *bits;
+	rational *r;
+	if ((bits = _bench_integers(n * 2)) == NULL) return;
+	r = (rational *)bits;
+	for (i = 0; i < n; i++) {
+		r[i].num = (long long)(bits[2 * i] >> 34) * 12;
+		r[i].den = (long long)(bits[2 * i + 1] >> 34 | 1) * 18;
+	}
+	bench_start(b);
+	bench_sink += rational_reduce_array(r, n);
+	bench_stop(b);
+	b->ops = n;
+	free(r);
+}
+
+const bench_case bench_numbers[] = {
+	{ "numbers/dec2hex_array", _bench_dec2hex_array },
+	{ "numbers/hex2dec_array", _bench_hex2dec_array },
+	{ "numbers/dec2bin_array", _bench_dec2bin_array },
+	{ "numbers/xround_array_d", _bench_xround_array_d },
+	{ "numbers/xround", _bench_xround },
+	{ "numbers/rational_reduce_array", _bench_rational_reduce_array },
+	{ NULL, NULL },
+};
@@ -0,0 +1,66 @@
+/********************************************************************
+ * Name: bench_os.c
+ * Author: rashaudteague
+ * License: GNU LGPL <http://www.gnu.org/licenses/>
+ * Description: os.c and io.c benchmarks
+ ********************************************************************/
+
+#include "bench.h"
+
+static void _bench_shell_run(bench_state *b) {
+	shell_result r;
+	unsigned long i, n = 50 * b->scale;
+	bench_start(b);
+	for (i = 0; i < n; i++) {
+		if (shell_run("echo xbench", NULL, &r) == 0) bench_sink += r.out_len;
+		shell_result_free(&r);
+	}
+	bench_stop(b);
+	b->ops = n;
+}
+
+static void _bench_xlog(bench_state *b) {
+	unsigned long i, n = 1000000 * b->scale;
+	int fd;
+	if ((fd = open("/dev/null", O_WRONLY, 0)) == -1) return;
+	if (!xlog_init(fd, XLOG_INFO, 0, XLOG_BLOCK)) { close(fd); return; }
+	bench_start(b);
+	for (i = 0; i < n; i++) xlog(XLOG_INFO, "request id=%lu path=%s status=%d", i, "/api/v1/users", 200);
+	bench_stop(b);
+	b->ops = n;
+	xlog_shutdown();
+	close(fd);
+}
+
+static int _bench_discard(const char *data, size_t len, void *arg) {
+	bench_sink += len;
+	return 0;
+}
+
+static void _bench_list_serialize(bench_state *b) {
+	list *l;
+	double *values;
+	xwriter w;
+	unsigned long i, n = 1000000 * b->scale;
+	if ((values = (double *)malloc(n * sizeof(double))) == NULL) return;
+	if ((l = list_init()) == NULL) { free(values); return; }
+	for (i = 0; i < n; i++) {
+		values[i] = i % 3 == 0 ? (double)i : i / 7.0;
+		list_push_back(l, &values[i], DOUBLE, NONDYNAMIC);
+	}
+	bench_start(b);
+	xwriter_sink(&w, _bench_discard, NULL, 0);
+	list_serialize(&w, l, XSERIAL_JSON);
+	xwriter_close(&w);
+	bench_stop(b);
+	b->ops = n;
+	list_destroy(l);
+	free(values);
+}
+
+const bench_case bench_os[] = {
+	{ "os/shell_run", _bench_shell_run },
+	{ "io/xlog", _bench_xlog },
+	{ "io/list_serialize", _bench_list_serialize },
+	{ NULL, NULL },
+};
@@ -0,0 +1,146 @@
+/********************************************************************
+ * Name: bench_strings.c
+ * Author: rashaudteague
+ * License: GNU LGPL <http://www.gnu.org/licenses/>
+ * Description: strings.c benchmarks over generated log lines
+ ********************************************************************/
+
+#include "bench.h"
+
+typedef struct __bench_log__ {
+	char *text;
+	char **lines;
+	size_t count;
+	size_t bytes;
+} _bench_log;
+
+static int _bench_log_init(_bench_log *log, bench_state *b, size_t bytes) {
+	if ((log->text = bench_log_text(bytes * b->scale, &log->count)) == NULL) return 0;
+	log->bytes = strlen(log->text);
+	if ((log->lines = bench_log_lines(log->text, log->count)) == NULL) { free(log->text); return 0; }
+	return 1;
+}
+
+static void _bench_log_free(_bench_log *log) {
+	free(log->lines);
+	free(log->text);
+}
+
+static void _bench_strpos(bench_state *b) {
+	_bench_log log;
+	size_t i;
+	if (!_bench_log_init(&log, b, 16 * MB)) return;
+	bench_start(b);
+	for (i = 0; i < log.count; i++) bench_sink += strpos("status=", log.lines[i], 0);
+	bench_stop(b);
+	b->ops = log.count;
+	b->bytes = log.bytes;
+	_bench_log_free(&log);
+}
+
+static void _bench_split(bench_state *b) {
+	_bench_log log;
+	char *elements[64];
+	size_t i;
+	int n;
+	if (!_bench_log_init(&log, b, 4 * MB)) return;
+	bench_start(b);
+	for (i = 0; i < log.count; i++) {
+		n = split(" ", log.lines[i], elements);
+		bench_sink += n;
+		split_free(elements, n);
+	}
+	bench_stop(b);
+	b->ops = log.count;
+	b->bytes = log.bytes;
+	_bench_log_free(&log);
+}
+
+static void _bench_str_replace(bench_state *b) {
+	_bench_log log;
+	char buffer[1024];
+	size_t i;
+	if (!_bench_log_init(&log, b, 4 * MB)) return;
+	bench_start(b);
+	for (i = 0; i < log.count; i++) {
+		/* str_replace() appends at strlen(buffer) as it goes */
+		memset(buffer, 0, sizeof(buffer));
+		str_replace("INFO", "NOTICE", log.lines[i], buffer);
+		bench_sink += buffer[0];
+	}
+	bench_stop(b);
+	b->ops = log.count;
+	b->bytes = log.bytes;
+	_bench_log_free(&log);
+}
+
+static void _bench_strtoupper(bench_state *b) {
+	size_t lines, len;
+	char *text;
+	if ((text = bench_log_text(16 * MB * b->scale, &lines)) == NULL) return;
+	len = strlen(text);
+	bench_start(b);
+	strtoupper(text);
+	bench_stop(b);
+	bench_sink += text[0];
+	b->ops = len;
+	b->bytes = len;
+	free(text);
+}
+
+static void _bench_trim(bench_state *b) {
+	char buffer[128];
+	unsigned long i, n = 1000000 * b->scale;
+	bench_start(b);
+	for (i = 0; i < n; i++) {
+		strcpy(buffer, "   \t padded value with spaces \t\n  ");
+		bench_sink += trim(buffer)[0];
+	}
+	bench_stop(b);
+	b->ops = n;
+}
+
+static void _bench_utf8_validate(bench_state *b) {
+	size_t lines, len;
+	char *text;
+	if ((text = bench_log_text(16 * MB * b->scale, &lines)) == NULL) return;
+	len = strlen(text);
+	bench_start(b);
+	bench_sink += utf8_validate(text, len, NULL) + ascii_printable_span(text, len);
+	bench_stop(b);
+	b->ops = len;
+	b->bytes = len;
+	free(text);
+}
+
+static void _bench_rope_edit(bench_state *b) {
+	size_t lines, len, pos;
+	unsigned long i, n = 200000 * b->scale;
+	char *text;
+	rope *r;
+	if ((text = bench_log_text(4 * MB * b->scale, &lines)) == NULL) return;
+	len = strlen(text);
+	if ((r = rope_init_n(text, len)) == NULL) { free(text); return; }
+	bench_start(b);
+	for (i = 0; i < n; i++) {
+		pos = (i * 2654435761UL) % rope_length(r);
+		if (i & 1) rope_delete(r, pos, 8);
+		else rope_insert(r, pos, "inserted", 8);
+	}
+	bench_stop(b);
+	bench_sink += rope_length(r);
+	b->ops = n;
+	rope_destroy(r);
+	free(text);
+}
+
+const bench_case bench_strings[] = {
+	{ "strings/strpos", _bench_strpos },
+	{ "strings/split", _bench_split },
+	{ "strings/str_replace", _bench_str_replace },
+	{ "strings/strtoupper", _bench_strtoupper },
+	{ "strings/trim", _bench_trim },
+	{ "strings/utf8_validate", _bench_utf8_validate },
+	{ "strings/rope_edit", _bench_rope_edit },
+	{ NULL, NULL },
+};
@@ -0,0 +1,254 @@
+/********************************************************************
+ * Name: bloom.c
+ * Author: rashaudteague
+ * License: GNU LGPL <http://www.gnu.org/licenses/>
+ * Description: Blocked Bloom filters
+ ********************************************************************/
+
+#include "xstdlib.h"
+
+/*
+ * A blocked Bloom filter puts all k bits of a key into one 512-bit block,
+ * a single cache line, picked by the top of the key's hash. Lookups cost
+ * one cache miss instead of k, for a slightly higher false positive rate
+ * than a classic filter of the same size.
+ */
+
+#define BLOOM_BLOCK_WORDS (BLOOM_BLOCK_BITS / 64)
+#define BLOOM_BATCH 16
+
+static uint64_t *_bloom_block(const bloom *b, uint64_t h) {
+	return b->bits + (size_t)(((h >> 32) * b->nblocks) >> 32) * BLOOM_BLOCK_WORDS;
+}
+
+/**
+ * The k bit positions of h within its block, as a mask per block word
+ */
+static void _bloom_mask(const bloom *b, uint64_t h, uint64_t mask[BLOOM_BLOCK_WORDS]) {
+	unsigned int i, bit;
+	memset(mask, 0, BLOOM_BLOCK_WORDS * sizeof(uint64_t));
+	for (i = 0; i < b->k; i++) {
+		h = h * 0x9E3779B97F4A7C15ULL + 0x7F4A7C15ULL;
+		bit = (unsigned int)(h >> 55);
+		mask[bit / 64] |= (uint64_t)1 << (bit % 64);
+	}
+}
+
+/**
+ * Allocators promise no more than malloc's alignment, so the blocks are
+ * over-allocated by a cache line and the start rounded up to one
+ */
+static bloom *_bloom_alloc(const xallocator *a, size_t nblocks, unsigned int k) {
+	bloom *b;
+	if (nblocks == 0 || nblocks > UINT32_MAX) return NULL;
+	if ((b = (bloom *)xalloc(a, sizeof(bloom))) == NULL) return NULL;
+	if ((b->mem = xalloc(a, nblocks * BLOOM_BLOCK_BITS / 8 + 63)) == NULL) { xalloc_free(a, b); return NULL; }
+	b->bits = (uint64_t *)(((uintptr_t)b->mem + 63) & ~(uintptr_t)63);
+	b->allocator = a;
+	b->nblocks = nblocks;
+	b->k = k;
+	b->count = 0;
+	memset(b->bits, 0, nblocks * BLOOM_BLOCK_BITS / 8);
+	return b;
+}
+
+/**
+ * Creates a filter sized for expected keys at a false positive rate of
+ * about fp_rate (0.01 for 1%). NULL if out of memory or fp_rate is not
+ * between 0 and 1.
+ */
+bloom *bloom_init(size_t expected, double fp_rate) {
+	return bloom_init_a(NULL, expected, fp_rate);
+}
+
+/**
+ * bloom_init() taking its memory from allocator a
+ */
+bloom *bloom_init_a(const xallocator *a, size_t expected, double fp_rate) {
+	double bits;
+	unsigned int k;
+
+	if (!(fp_rate > 0 && fp_rate < 1)) return NULL;
+	if (expected == 0) expected = 1;
+	bits = -(double)expected * log(fp_rate) / (M_LN2 * M_LN2);
+	k = (unsigned int)(bits / expected * M_LN2 + 0.5);
+	if (k < 1) k = 1;
+	if (k > BLOOM_MAX_K) k = BLOOM_MAX_K;
+	/* a tenth more room makes up for keys crowding into the same blocks */
+	return _bloom_alloc(a, (size_t)(bits * 1.1 / BLOOM_BLOCK_BITS) + 1, k);
+}
+
+void bloom_add_hash(bloom *b, uint64_t h) {
+	uint64_t mask[BLOOM_BLOCK_WORDS], *block = _bloom_block(b, h);
+	int i;
+	_bloom_mask(b, h, mask);
+	for (i = 0; i < BLOOM_BLOCK_WORDS; i++) block[i] |= mask[i];
+	b->count++;
+}
+
+/**
+ * Returns 0 if the key with hash h was never added, 1 if it may have been
+ */
+int bloom_test_hash(const bloom *b, uint64_t h) {
+	uint64_t mask[BLOOM_BLOCK_WORDS], miss = 0;
+	const uint64_t *block = _bloom_block(b, h);
+	int i;
+	_bloom_mask(b, h, mask);
+	for (i = 0; i < BLOOM_BLOCK_WORDS; i++) miss |= mask[i] & ~block[i];
+	return miss == 0;
+}
+
+void bloom_add(bloom *b, const void *key, size_t len) {
+	bloom_add_hash(b, hash_bytes64(key, len));
+}
+
+int bloom_test(const bloom *b, const void *key, size_t len) {
+	return bloom_test_hash(b, hash_bytes64(key, len));
+}
+
+/**
+ * Adds n strings. Hashes are worked out a batch at a time and their
+ * blocks prefetched before any of them is touched.
+ */
+void bloom_add_many(bloom *b, const char *const *keys, size_t n) {
+	uint64_t h[BLOOM_BATCH];
+	size_t i, j, m;
+	for (i = 0; i < n; i += m) {
+		m = n - i < BLOOM_BATCH ? n - i : BLOOM_BATCH;
+		for (j = 0; j < m; j++) {
+			h[j] = hash_bytes64(keys[i + j], strlen(keys[i + j]));
+			__builtin_prefetch(_bloom_block(b, h[j]), 1);
+		}
+		for (j = 0; j < m; j++) bloom_add_hash(b, h[j]);
+	}
+}
+
+/**
+ * Tests n strings, setting results[i] to whether keys[i] may be present.
+ * Returns how many may be.
+ */
+size_t bloom_test_many(const bloom *b, const char *const *keys, size_t n, unsigned char *results) {
+	uint64_t h[BLOOM_BATCH];
+	size_t i, j, m, found = 0;
+	for (i = 0; i < n; i += m) {
+		m = n - i < BLOOM_BATCH ? n - i : BLOOM_BATCH;
+		for (j = 0; j < m; j++) {
+			h[j] = hash_bytes64(keys[i + j], strlen(keys[i + j]));
+			__builtin_prefetch(_bloom_block(b, h[j]), 0);
+		}
+		for (j = 0; j < m; j++) found += (results[i + j] = (unsigned char)bloom_test_hash(b, h[j]));
+	}
+	return found;
+}
+
+void bloom_clear(bloom *b) {
+	memset(b->bits, 0, b->nblocks * BLOOM_BLOCK_BITS / 8);
+	b->count = 0;
+}
+
+void bloom_destroy(bloom *b) {
+	if (b == NULL) return;
+	xalloc_free(b->allocator, b->mem);
+	xalloc_free(b->allocator, b);
+}
+
+/**
+ * Writes the filter as a 64 byte header followed by the blocks in native
+ * byte order, returns 0 on a write error
+ */
+int bloom_write(const bloom *b, xwriter *w) {
+	xbloom_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, XBLOOM_MAGIC, sizeof(header.magic));
+	header.version = XBLOOM_VERSION;
+	header.byte_order = 0x01020304;
+	header.k = b->k;
+	header.nblocks = b->nblocks;
+	header.count = b->count;
+	xwriter_write(w, (const char *)&header, sizeof(header));
+	xwriter_write(w, (const char *)b->bits, b->nblocks * BLOOM_BLOCK_BITS / 8);
+	return !w->error;
+}
+
+/**
+ * Rebuilds a filter from what bloom_write() wrote, NULL if data is not a
+ * filter written on a machine like this one or is cut short
+ */
+bloom *bloom_read(const void *data, size_t len) {
+	const xbloom_header *header = (const xbloom_header *)data;
+	bloom *b;
+
+	if (len < sizeof(xbloom_header) || memcmp(header->magic, XBLOOM_MAGIC, sizeof(header->magic)) != 0
+			|| header->version != XBLOOM_VERSION || header->byte_order != 0x01020304
+			|| header->k < 1 || header->k > BLOOM_MAX_K
+			|| header->nblocks > (len - sizeof(xbloom_header)) / (BLOOM_BLOCK_BITS / 8))
+		return NULL;
+	if ((b = _bloom_alloc(NULL, header->nblocks, header->k)) == NULL) return NULL;
+	memcpy(b->bits, (const char *)data + sizeof(xbloom_header), b->nblocks * BLOOM_BLOCK_BITS / 8);
+	b->count = header->count;
+	return b;
+}
+
+int bloom_save(const bloom *b, const char *path) {
+	xwriter w;
+	int fd, ok;
+	if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) return 0;
+	xwriter_fd(&w, fd, 0);
+	bloom_write(b, &w);
+	ok = xwriter_close(&w);
+	if (close(fd) != 0) ok = 0;
+	if (!ok) unlink(path);
+	return ok;
+}
+
+bloom *bloom_load(const char *path) {
+	struct stat st;
+	void *map;
+	bloom *b;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) == -1) return NULL;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) { close(fd); return NULL; }
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) return NULL;
+	b = bloom_read(map, st.st_size);
+	munmap(map, st.st_size);
+	return b;
+}
+
+/**
+ * Builds a filter holding every key of a table
+ */
+bloom *hash_bloom(hashtab *h[], unsigned int size, double fp_rate) {
+	hashtab *entry;
+	size_t count = 0;
+	unsigned int i;
+	bloom *b;
+
+	for (i = 0; i < size; i++)
+		for (entry = h[i]; entry != NULL; entry = entry->next) count++;
+	if ((b = bloom_init(count, fp_rate)) == NULL) return NULL;
+	for (i = 0; i < size; i++)
+		for (entry = h[i]; entry != NULL; entry = entry->next) bloom_add(b, entry->key, strlen(entry->key));
+	return b;
+}
+
+/**
+ * hash_get() that rejects most absent keys with one probe of f, which
+ * must have seen every key set in the table
+ */
+hashtab *hash_get_filtered(const bloom *f, hashtab *h[], const char *key) {
+	if (!bloom_test(f, key, strlen(key))) return NULL;
+	return hash_get(h, key);
+}
+
+/**
+ * hash_set() that also adds the key to f. Keys unset later stay in the
+ * filter and only cost a false positive.
+ */
+hashtab *hash_set_filtered(bloom *f, hashtab *h[], const char *key, void *val, unsigned short type, void (*destroy)(void *v), void (*print)(void *v)) {
+	hashtab *n;
+	if ((n = hash_set(h, key, val, type, destroy, print)) != NULL) bloom_add(f, key, strlen(key));
+	return n;
+}
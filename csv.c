@@ -0,0 +1,328 @@
+/********************************************************************
+ * Name: csv.c
+ * Author: rashaudteague
+ * License: GNU LGPL <http://www.gnu.org/licenses/>
+ * Description: Streaming quote-aware CSV/TSV tokenizer
+ ********************************************************************/
+
+#include "xstdlib.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * Input is classified 64 bytes at a time into bitmasks of quotes,
+ * delimiters and newlines. A prefix XOR over the quote mask marks the bytes
+ * inside quotes, so delimiters and newlines there drop out and the fields
+ * are read straight off the remaining bits. Doubled quotes need no special
+ * case: they toggle out and back in. Only a block holding a backslash-style
+ * escape falls back to a byte loop.
+ *
+ * Fields point into the caller's chunk wherever possible. A record cut by
+ * the end of a chunk is copied aside and finished by the next csv_feed().
+ */
+
+#define _csv_escaping(p) ((p)->escape != '\0' && (p)->escape != (p)->quote)
+
+/**
+ * Bitmasks of the delimiters and newlines, quotes and escapes in the 64
+ * bytes at s, bit i standing for s[i]
+ */
+static inline void _csv_classify(const csv_parser *p, const char *s, uint64_t *structural, uint64_t *quotes, uint64_t *escapes) {
+#ifdef __SSE2__
+	__m128i delimiter = _mm_set1_epi8(p->delimiter), newline = _mm_set1_epi8('\n');
+	__m128i quote = _mm_set1_epi8(p->quote), escape = _mm_set1_epi8(p->escape), v;
+	int i;
+	*structural = *quotes = *escapes = 0;
+	for (i = 0; i < 4; i++) {
+		v = _mm_loadu_si128((const __m128i *)(s + i * 16));
+		*structural |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, delimiter), _mm_cmpeq_epi8(v, newline))) << (i * 16);
+		*quotes |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)) << (i * 16);
+		*escapes |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, escape)) << (i * 16);
+	}
+#else
+	int i;
+	*structural = *quotes = *escapes = 0;
+	for (i = 0; i < 64; i++) {
+		*structural |= (uint64_t)(s[i] == p->delimiter || s[i] == '\n') << i;
+		*quotes |= (uint64_t)(s[i] == p->quote) << i;
+		*escapes |= (uint64_t)(s[i] == p->escape) << i;
+	}
+#endif
+	if (p->quote == '\0') *quotes = 0;
+	if (!_csv_escaping(p)) *escapes = 0;
+}
+
+static uint64_t _csv_prefix_xor(uint64_t x) {
+	x ^= x << 1;
+	x ^= x << 2;
+	x ^= x << 4;
+	x ^= x << 8;
+	x ^= x << 16;
+	x ^= x << 32;
+	return x;
+}
+
+/**
+ * Byte loop for blocks with escapes: sets a bit for each delimiter or
+ * newline outside quotes, carrying the quote and escape state
+ */
+static uint64_t _csv_block_slow(const csv_parser *p, const char *s, int *quoted, int *escaped) {
+	uint64_t m = 0;
+	int i;
+	for (i = 0; i < 64; i++) {
+		if (*escaped) *escaped = 0;
+		else if (s[i] == p->escape && _csv_escaping(p)) *escaped = 1;
+		else if (s[i] == p->quote && p->quote != '\0') *quoted = !*quoted;
+		else if (!*quoted && (s[i] == p->delimiter || s[i] == '\n')) m |= (uint64_t)1 << i;
+	}
+	return m;
+}
+
+/**
+ * The delimiters and newlines outside quotes in the 64 bytes at s
+ */
+static inline uint64_t _csv_block(const csv_parser *p, const char *s, int *quoted, int *escaped) {
+	uint64_t structural, quotes, escapes, inside;
+
+	_csv_classify(p, s, &structural, &quotes, &escapes);
+	if (escapes != 0 || *escaped) return _csv_block_slow(p, s, quoted, escaped);
+	if (quotes == 0) return *quoted ? 0 : structural;
+	inside = _csv_prefix_xor(quotes) ^ (*quoted ? ~(uint64_t)0 : 0);
+	*quoted = (int)(inside >> 63);
+	return structural & ~inside;
+}
+
+static int _csv_reserve(void **buf, size_t *size, size_t need, size_t item) {
+	size_t grown = *size > 0 ? *size : 16;
+	void *p;
+	if (need <= *size) return 1;
+	while (grown < need) grown *= 2;
+	if ((p = realloc(*buf, grown * item)) == NULL) return 0;
+	XSTATS_BYTES(grown * item);
+	*buf = p;
+	*size = grown;
+	return 1;
+}
+
+/**
+ * Copies len bytes to out dropping escapes, returns the new length
+ */
+static size_t _csv_unescape(const csv_parser *p, const char *s, size_t len, char *out) {
+	char escape = _csv_escaping(p) ? p->escape : p->quote;
+	size_t i, n = 0;
+	for (i = 0; i < len; i++) {
+		if (s[i] == escape && i + 1 < len) i++;
+		out[n++] = s[i];
+	}
+	return n;
+}
+
+/**
+ * Strips the quotes and escapes off the fields collected so far and hands
+ * them to the callback. Blank lines are skipped. Returns 0 if parsing
+ * should stop.
+ */
+static int _csv_record(csv_parser *p) {
+	char escape = _csv_escaping(p) ? p->escape : p->quote;
+	size_t i, need = 0, used = 0;
+	csv_field *f, *last = &p->fields[p->count - 1];
+
+	if (last->len > 0 && last->data[last->len - 1] == '\r') last->len--;
+	if (p->count == 1 && last->len == 0) { p->count = 0; return 1; }
+	for (i = 0; i < p->count; i++) {
+		f = &p->fields[i];
+		f->quoted = p->quote != '\0' && f->len > 0 && f->data[0] == p->quote;
+		if (f->quoted) {
+			f->data++;
+			f->len--;
+			if (f->len > 0 && f->data[f->len - 1] == p->quote) f->len--;
+		}
+		if (escape != '\0' && (f->quoted || _csv_escaping(p))) need += f->len;
+	}
+	if (need > 0) {
+		if (!_csv_reserve((void **)&p->scratch, &p->scratch_size, need, 1)) { p->status = -1; return 0; }
+		for (i = 0; i < p->count; i++) {
+			f = &p->fields[i];
+			if (!(f->quoted || _csv_escaping(p)) || memchr(f->data, escape, f->len) == NULL) continue;
+			f->len = _csv_unescape(p, f->data, f->len, p->scratch + used);
+			f->data = p->scratch + used;
+			used += f->len;
+		}
+	}
+	p->records++;
+	i = p->count;
+	p->count = 0;
+	if (p->callback(p->fields, i, p->arg) != 0) { p->status = 1; return 0; }
+	return 1;
+}
+
+/**
+ * Parses every complete record in data, returns the offset of the first
+ * byte of the unfinished one (len if there is none)
+ */
+static size_t _csv_scan(csv_parser *p, const char *data, size_t len) {
+	size_t i, at, field = 0, record = 0, count = 0;
+	int quoted = 0, escaped = 0;
+	csv_field *fields = p->fields;
+	uint64_t m;
+	char tail[64];
+	const char *s;
+
+	for (i = 0; i < len; i += 64) {
+		s = data + i;
+		if (len - i < 64) {
+			/* whatever the padding matches lies past len and is ignored */
+			memset(tail, 0, 64);
+			memcpy(tail, s, len - i);
+			s = tail;
+		}
+		for (m = _csv_block(p, s, &quoted, &escaped); m != 0; m &= m - 1) {
+			at = i + __builtin_ctzll(m);
+			if (at >= len) break;
+			/* the field count lives in a local so the stores below cannot alias it */
+			if (count == p->fields_size) {
+				if (!_csv_reserve((void **)&p->fields, &p->fields_size, count + 1, sizeof(csv_field))) {
+					p->status = -1;
+					return record;
+				}
+				fields = p->fields;
+			}
+			fields[count].data = data + field;
+			fields[count].len = at - field;
+			count++;
+			field = at + 1;
+			if (data[at] == '\n') {
+				p->count = count;
+				count = 0;
+				if (!_csv_record(p)) return at + 1;
+				record = at + 1;
+			}
+		}
+	}
+	return record;
+}
+
+/**
+ * Walks the record left over from the last chunk into data, returns the
+ * offset of its newline or len when the record goes on past data
+ */
+static size_t _csv_record_end(csv_parser *p, const char *data, size_t len) {
+	size_t i;
+	for (i = 0; i < len; i++) {
+		if (p->carry_escaped) p->carry_escaped = 0;
+		else if (data[i] == p->escape && _csv_escaping(p)) p->carry_escaped = 1;
+		else if (data[i] == p->quote && p->quote != '\0') p->carry_quoted = !p->carry_quoted;
+		else if (data[i] == '\n' && !p->carry_quoted) return i;
+	}
+	return len;
+}
+
+static int _csv_carry(csv_parser *p, const char *data, size_t len) {
+	if (!_csv_reserve((void **)&p->carry, &p->carry_size, p->carry_len + len, 1)) return 0;
+	memcpy(p->carry + p->carry_len, data, len);
+	p->carry_len += len;
+	return 1;
+}
+
+/**
+ * Creates a parser calling callback(fields, count, arg) once per record;
+ * a nonzero return stops parsing. quote '\0' turns quoting off. escape
+ * '\0' or equal to quote means quotes are escaped by doubling them ("");
+ * anything else escapes the byte after it, inside quotes or not.
+ * Returns NULL if the delimiter is '\0' or '\n', or out of memory.
+ */
+csv_parser *csv_init(char delimiter, char quote, char escape, csv_callback callback, void *arg) {
+	csv_parser *p;
+	if (delimiter == '\0' || delimiter == '\n' || delimiter == quote || delimiter == escape) return NULL;
+	if ((p = (csv_parser *)calloc(1, sizeof(csv_parser))) == NULL) return NULL;
+	p->delimiter = delimiter;
+	p->quote = quote;
+	p->escape = escape;
+	p->callback = callback;
+	p->arg = arg;
+	return p;
+}
+
+/**
+ * Parses the next len bytes of input, which may end anywhere. The fields
+ * passed to the callback are only valid during the call. Returns 1 to keep
+ * feeding, 0 once the callback has stopped the parser, -1 if out of memory.
+ */
+int csv_feed(csv_parser *p, const char *data, size_t len) {
+	size_t at;
+
+	XSTATS_SCOPE(XSTATS_CSV_FEED);
+	if (p->status != 0) return p->status > 0 ? 0 : -1;
+	if (p->carry_len > 0) {
+		at = _csv_record_end(p, data, len);
+		if (!_csv_carry(p, data, at < len ? at + 1 : len)) return -1;
+		if (at == len) return 1;
+		_csv_scan(p, p->carry, p->carry_len);
+		p->carry_len = 0;
+		p->carry_quoted = p->carry_escaped = 0;
+		if (p->status != 0) return p->status > 0 ? 0 : -1;
+		data += at + 1;
+		len -= at + 1;
+	}
+	at = _csv_scan(p, data, len);
+	if (p->status != 0) return p->status > 0 ? 0 : -1;
+	if (at < len) {
+		if (!_csv_carry(p, data + at, len - at)) return -1;
+		_csv_record_end(p, data + at, len - at);
+	}
+	return 1;
+}
+
+/**
+ * Ends the input, parsing a last record that has no trailing newline.
+ * An unterminated quote runs to the end of the input. Returns as csv_feed().
+ */
+int csv_finish(csv_parser *p) {
+	if (p->status == 0 && p->carry_len > 0) {
+		if ((p->carry_quoted && !_csv_carry(p, &p->quote, 1)) || !_csv_carry(p, "\n", 1)) return -1;
+		_csv_scan(p, p->carry, p->carry_len);
+	}
+	p->carry_len = 0;
+	p->carry_quoted = p->carry_escaped = 0;
+	return p->status == 0 ? 1 : p->status > 0 ? 0 : -1;
+}
+
+void csv_destroy(csv_parser *p) {
+	if (p == NULL) return;
+	free(p->fields);
+	free(p->carry);
+	free(p->scratch);
+	free(p);
+}
+
+/**
+ * Streams the file at path through a parser, returns the number of records
+ * seen or -1 on error
+ */
+long long csv_foreach_record(const char *path, char delimiter, char quote, char escape, csv_callback callback, void *arg) {
+	csv_parser *p;
+	char *buf;
+	ssize_t n;
+	int fd, rc = 1;
+	long long records;
+
+	if ((p = csv_init(delimiter, quote, escape, callback, arg)) == NULL) return -1;
+	if ((buf = (char *)malloc(CSV_BUFSIZE)) == NULL) { csv_destroy(p); return -1; }
+	if ((fd = open(path, O_RDONLY, 0)) == -1) { free(buf); csv_destroy(p); return -1; }
+
+	while (rc > 0 && (n = read(fd, buf, CSV_BUFSIZE)) != 0) {
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			rc = -1;
+			break;
+		}
+		rc = csv_feed(p, buf, n);
+	}
+	if (rc > 0) rc = csv_finish(p);
+	records = p->records;
+	close(fd);
+	free(buf);
+	csv_destroy(p);
+	return rc < 0 ? -1 : records;
+}
@@ -0,0 +1,138 @@
+/********************************************************************
+ * Name: deque.c
+ * Author: rashaudteague
+ * License: GNU LGPL <http://www.gnu.org/licenses/>
+ * Description: A growable ring-buffer deque
+ ********************************************************************/
+
+#include "xstdlib.h"
+
+/*
+ * Slots live in one power-of-two array used as a ring, so pushes and pops
+ * at either end are O(1) and only growing the array allocates.
+ */
+
+#define _deque_slot(d, i) (&(d)->slots[((d)->head + (i)) & ((d)->cap - 1)])
+
+static void _deque_free_data(deque *d, deque_slot *s) {
+	if (d->destroy != NULL) d->destroy(s->data);
+	else if (s->memory_type == DYNAMIC) free(s->data);
+	s->data = NULL;
+}
+
+static int _deque_grow(deque *d) {
+	deque_slot *slots;
+	size_t i;
+
+	if ((slots = (deque_slot *)xalloc(d->allocator, d->cap * 2 * sizeof(deque_slot))) == NULL) return 0;
+	for (i = 0; i < d->size; i++) slots[i] = *_deque_slot(d, i);
+	xalloc_free(d->allocator, d->slots);
+	d->slots = slots;
+	d->head = 0;
+	d->cap *= 2;
+	return 1;
+}
+
+deque *deque_init(size_t capacity) {
+	return deque_init_a(NULL, capacity);
+}
+
+/**
+ * Creates a deque with room for capacity elements before it has to grow,
+ * taking its memory from allocator a. DYNAMIC data is the caller's
+ * malloc()ed memory and is free()d.
+ */
+deque *deque_init_a(const xallocator *a, size_t capacity) {
+	deque *d;
+	size_t cap = DEQUE_MIN_CAPACITY;
+
+	while (cap < capacity) cap <<= 1;
+	if ((d = (deque *)xalloc(a, sizeof(deque))) == NULL) return NULL;
+	if ((d->slots = (deque_slot *)xalloc(a, cap * sizeof(deque_slot))) == NULL) { xalloc_free(a, d); return NULL; }
+	d->allocator = a;
+	d->head = 0;
+	d->size = 0;
+	d->cap = cap;
+	d->destroy = NULL;
+	return d;
+}
+
+/**
+ * Returns 1 on success, 0 if out of memory
+ */
+int deque_push_back(deque *d, void *data, unsigned short type, unsigned short memory_type) {
+	deque_slot *s;
+	if (d->size == d->cap && !_deque_grow(d)) return 0;
+	s = _deque_slot(d, d->size);
+	s->data = data;
+	s->type = type;
+	s->memory_type = memory_type;
+	d->size++;
+	return 1;
+}
+
+int deque_push_front(deque *d, void *data, unsigned short type, unsigned short memory_type) {
+	deque_slot *s;
+	if (d->size == d->cap && !_deque_grow(d)) return 0;
+	d->head = (d->head - 1) & (d->cap - 1);
+	s = &d->slots[d->head];
+	s->data = data;
+	s->type = type;
+	s->memory_type = memory_type;
+	d->size++;
+	return 1;
+}
+
+/**
+ * Removes the last element and returns its data, which now belongs to the
+ * caller. NULL when empty.
+ */
+void *deque_pop_back(deque *d) {
+	if (d->size == 0) return NULL;
+	d->size--;
+	return _deque_slot(d, d->size)->data;
+}
+
+void *deque_pop_front(deque *d) {
+	void *data;
+	if (d->size == 0) return NULL;
+	data = d->slots[d->head].data;
+	d->head = (d->head + 1) & (d->cap - 1);
+	d->size--;
+	return data;
+}
+
+/**
+ * The i-th element from the front, NULL if out of range
+ */
+deque_slot *deque_at(const deque *d, size_t i) {
+	return i < d->size ? _deque_slot(d, i) : NULL;
+}
+
+void *deque_front(const deque *d) {
+	return d->size > 0 ? d->slots[d->head].data : NULL;
+}
+
+void *deque_back(const deque *d) {
+	return d->size > 0 ? _deque_slot(d, d->size - 1)->data : NULL;
+}
+
+/**
+ * Removes every element, passing each one's data to the destroy callback
+ * or freeing it if it is DYNAMIC
+ */
+void deque_clear(deque *d) {
+	size_t i;
+	for (i = 0; i < d->size; i++) _deque_free_data(d, _deque_slot(d, i));
+	d->head = 0;
+	d->size = 0;
+}
+
+void deque_destroy(deque *d) {
+	const xallocator *a;
+	if (d == NULL) return;
+	a = d->allocator;
+	deque_clear(d);
+	xalloc_free(a, d->slots);
+	xalloc_free(a, d);
+}
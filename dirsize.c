@@ -0,0 +1,292 @@
+/********************************************************************
+ * Name: dirsize.c
+ * Author: rashaudteague
+ * License: GNU LGPL <http://www.gnu.org/licenses/>
+ * Description: Directory sizes kept up to date from inotify events
+ ********************************************************************/
+
+#include "xstdlib.h"
+
+#ifdef __linux__
+
+/*
+ * One node per directory holds the st_size sum of its direct entries (own)
+ * and of its whole subtree (total), which is what filesize() returns for
+ * it. Every directory has an inotify watch. An event only marks its
+ * directory dirty; the next query re-reads the dirty directories and
+ * pushes the change in their own size up to the root, so a burst of writes
+ * costs one readdir per directory touched. A queue overflow loses events
+ * and falls back to a full rescan.
+ */
+
+#define DIRSIZE_EVENTS (IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB \
+	| IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW)
+
+/**
+ * Writes n's full path to buffer, returns its length or 0 if too long
+ */
+static size_t _dirsize_path(const dirsize_node *n, char *buffer) {
+	size_t len = 0, part = strlen(n->name);
+	if (n->parent != NULL) {
+		if ((len = _dirsize_path(n->parent, buffer)) == 0) return 0;
+		if (buffer[len - 1] != '/') buffer[len++] = '/';
+	}
+	if (len + part >= PATH_MAX) return 0;
+	memcpy(buffer + len, n->name, part + 1);
+	return len + part;
+}
+
+static int _dirsize_watch(dirsize *d, dirsize_node *n, const char *path) {
+	dirsize_node **by_wd;
+	size_t size;
+
+	if ((n->wd = inotify_add_watch(d->fd, path, DIRSIZE_EVENTS)) < 0) return 0;
+	if ((size_t)n->wd >= d->by_wd_size) {
+		for (size = d->by_wd_size > 0 ? d->by_wd_size : 64; size <= (size_t)n->wd; size *= 2);
+		if ((by_wd = (dirsize_node **)realloc(d->by_wd, size * sizeof(dirsize_node *))) == NULL) {
+			inotify_rm_watch(d->fd, n->wd);
+			n->wd = -1;
+			return 0;
+		}
+		memset(by_wd + d->by_wd_size, 0, (size - d->by_wd_size) * sizeof(dirsize_node *));
+		d->by_wd = by_wd;
+		d->by_wd_size = size;
+	}
+	d->by_wd[n->wd] = n;
+	return 1;
+}
+
+static void _dirsize_free(dirsize *d, dirsize_node *n) {
+	dirsize_node *child, *next, **link;
+	for (child = n->children; child != NULL; child = next) {
+		next = child->sibling;
+		_dirsize_free(d, child);
+	}
+	if (n->wd >= 0) {
+		d->by_wd[n->wd] = NULL;
+		inotify_rm_watch(d->fd, n->wd);
+	}
+	if (n->dirty) {
+		for (link = &d->dirty; *link != n; link = &(*link)->next_dirty);
+		*link = n->next_dirty;
+	}
+	free(n);
+}
+
+static void _dirsize_unlink(dirsize_node *parent, dirsize_node *n) {
+	dirsize_node **link;
+	for (link = &parent->children; *link != n; link = &(*link)->sibling);
+	*link = n->sibling;
+}
+
+static dirsize_node *_dirsize_node(dirsize_node *parent, const char *name) {
+	dirsize_node *n;
+	size_t len = strlen(name);
+	if ((n = (dirsize_node *)calloc(1, sizeof(dirsize_node) + len + 1)) == NULL) return NULL;
+	memcpy(n->name, name, len + 1);
+	n->parent = parent;
+	n->wd = -1;
+	if (parent != NULL) {
+		n->sibling = parent->children;
+		parent->children = n;
+	}
+	return n;
+}
+
+static dirsize_node *_dirsize_child(const dirsize_node *n, const char *name, size_t len) {
+	dirsize_node *child;
+	for (child = n->children; child != NULL; child = child->sibling)
+		if (strncmp(child->name, name, len) == 0 && child->name[len] == '\0') return child;
+	return NULL;
+}
+
+static long long _dirsize_read(dirsize *d, dirsize_node *n, char *path, int scan);
+
+/**
+ * Adds the directory name under parent, with path holding its full path,
+ * and scans everything below it
+ */
+static dirsize_node *_dirsize_add(dirsize *d, dirsize_node *parent, const char *name, char *path) {
+	dirsize_node *n;
+	if ((n = _dirsize_node(parent, name)) == NULL) return NULL;
+	/* watch before reading so nothing written in between goes unseen */
+	_dirsize_watch(d, n, path);
+	n->own = _dirsize_read(d, n, path, 1);
+	n->total += n->own;
+	return n;
+}
+
+/**
+ * Sums the st_size of the direct entries of n, whose full path is in path.
+ * With scan set, n must be new: every subdirectory is added and scanned
+ * too, their paths built on the end of the same buffer.
+ */
+static long long _dirsize_read(dirsize *d, dirsize_node *n, char *path, int scan) {
+	size_t base = strlen(path), len, name_len;
+	struct dirent *df;
+	struct stat fs;
+	dirsize_node *child;
+	long long own = 0;
+	DIR *dir;
+	int fd;
+
+	if ((dir = opendir(path)) == NULL) return 0;
+	fd = dirfd(dir);
+	while ((df = readdir(dir)) != NULL) {
+		if (strcmp(df->d_name, ".") == 0 || strcmp(df->d_name, "..") == 0) continue;
+		if (fstatat(fd, df->d_name, &fs, 0) == -1) continue;
+		own += fs.st_size;
+		if (!scan || !S_ISDIR(fs.st_mode)) continue;
+		/* symlinked directories count but are not descended into */
+		if (fstatat(fd, df->d_name, &fs, AT_SYMLINK_NOFOLLOW) == -1 || !S_ISDIR(fs.st_mode)) continue;
+		name_len = strlen(df->d_name);
+		/* readdir() names each entry once, so no need to look for it among n's children */
+		if (base + name_len + 2 > PATH_MAX) continue;
+		len = base;
+		if (path[len - 1] != '/') path[len++] = '/';
+		memcpy(path + len, df->d_name, name_len + 1);
+		if ((child = _dirsize_add(d, n, df->d_name, path)) != NULL) n->total += child->total;
+		path[base] = '\0';
+	}
+	closedir(dir);
+	return own;
+}
+
+static void _dirsize_propagate(dirsize_node *n, long long delta) {
+	for (; n != NULL; n = n->parent) n->total += delta;
+}
+
+static void _dirsize_mark(dirsize *d, dirsize_node *n) {
+	if (n->dirty) return;
+	n->dirty = 1;
+	n->next_dirty = d->dirty;
+	d->dirty = n;
+}
+
+static int _dirsize_scan(dirsize *d) {
+	char path[PATH_MAX];
+	if ((d->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) return 0;
+	strcpy(path, d->path);
+	if ((d->root = _dirsize_add(d, NULL, d->path, path)) == NULL || d->root->wd < 0) return 0;
+	d->rescans++;
+	return 1;
+}
+
+static void _dirsize_teardown(dirsize *d) {
+	if (d->root != NULL) _dirsize_free(d, d->root);
+	d->root = NULL;
+	d->dirty = NULL;
+	if (d->fd >= 0) close(d->fd);
+	d->fd = -1;
+}
+
+/**
+ * Scans the tree under path once and starts watching it. NULL if path is
+ * not a directory or inotify is not available.
+ */
+dirsize *dirsize_open(const char *path) {
+	dirsize *d;
+	if ((d = (dirsize *)calloc(1, sizeof(dirsize))) == NULL) return NULL;
+	d->fd = -1;
+	if (realpath(path, d->path) == NULL || !_dirsize_scan(d)) {
+		dirsize_close(d);
+		return NULL;
+	}
+	return d;
+}
+
+/**
+ * Applies the events queued since the last call. Returns 1, or 0 if the
+ * tree had to be rescanned and that failed.
+ */
+int dirsize_update(dirsize *d) {
+	char buf[64 * KB] __attribute__((__aligned__(__alignof__(struct inotify_event))));
+	const struct inotify_event *e;
+	char path[PATH_MAX];
+	dirsize_node *n, *child;
+	long long own;
+	size_t plen;
+	ssize_t len;
+	char *p;
+
+	if (d->root == NULL) {
+		_dirsize_teardown(d);
+		return _dirsize_scan(d);
+	}
+	while ((len = read(d->fd, buf, sizeof(buf))) > 0) {
+		for (p = buf; p < buf + len; p += sizeof(struct inotify_event) + e->len) {
+			e = (const struct inotify_event *)p;
+			if (e->mask & IN_Q_OVERFLOW) {
+				_dirsize_teardown(d);
+				return _dirsize_scan(d);
+			}
+			if (e->wd < 0 || (size_t)e->wd >= d->by_wd_size || (n = d->by_wd[e->wd]) == NULL) continue;
+			if (e->mask & IN_IGNORED) {
+				/* the directory went away and the kernel dropped its watch */
+				d->by_wd[e->wd] = NULL;
+				n->wd = -1;
+				continue;
+			}
+			d->events++;
+			_dirsize_mark(d, n);
+			if (!(e->mask & IN_ISDIR) || e->len == 0) continue;
+			if (e->mask & (IN_DELETE | IN_MOVED_FROM)) {
+				if ((child = _dirsize_child(n, e->name, strlen(e->name))) == NULL) continue;
+				_dirsize_propagate(n, -child->total);
+				_dirsize_unlink(n, child);
+				_dirsize_free(d, child);
+			} else if ((e->mask & (IN_CREATE | IN_MOVED_TO)) && _dirsize_child(n, e->name, strlen(e->name)) == NULL) {
+				if ((plen = _dirsize_path(n, path)) == 0 || plen + strlen(e->name) + 2 > PATH_MAX) continue;
+				if (path[plen - 1] != '/') path[plen++] = '/';
+				strcpy(path + plen, e->name);
+				if ((child = _dirsize_add(d, n, e->name, path)) != NULL) _dirsize_propagate(n, child->total);
+			}
+		}
+	}
+
+	while ((n = d->dirty) != NULL) {
+		d->dirty = n->next_dirty;
+		n->dirty = 0;
+		own = _dirsize_path(n, path) > 0 ? _dirsize_read(d, n, path, 0) : 0;
+		_dirsize_propagate(n, own - n->own);
+		n->own = own;
+	}
+	return 1;
+}
+
+/**
+ * Returns what filesize() would for path, a directory under the tracked
+ * one given relative to it (NULL or "" for the tracked directory itself).
+ * -1 if it is not a directory in the tree.
+ */
+long long dirsize_get(dirsize *d, const char *path) {
+	const char *end;
+	dirsize_node *n;
+
+	if (!dirsize_update(d)) return -1;
+	n = d->root;
+	while (path != NULL && *path != '\0' && n != NULL) {
+		if (*path == '/') { path++; continue; }
+		for (end = path; *end != '\0' && *end != '/'; end++);
+		if (end - path == 1 && path[0] == '.') { path = end; continue; }
+		n = _dirsize_child(n, path, end - path);
+		path = end;
+	}
+	return n != NULL ? n->total : -1;
+}
+
+/**
+ * The inotify descriptor, to poll() for changes instead of asking
+ */
+int dirsize_fd(const dirsize *d) {
+	return d->fd;
+}
+
+void dirsize_close(dirsize *d) {
+	if (d == NULL) return;
+	_dirsize_teardown(d);
+	free(d->by_wd);
+	free(d);
+}
+
+#endif
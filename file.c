@@ -65,37 +65,42 @@ long long fappend(const char *path, char *data) {
  * @return int line_count
  */
 int file(const char *filename, char *elements[], unsigned char flags) {
+	return file_a(NULL, filename, elements, flags);
+}
+
+/**
+ * file() with the lines taken from allocator a (NULL for the default),
+ * released with file_free_a()
+ */
+int file_a(const xallocator *a, const char *filename, char *elements[], unsigned char flags) {
 	int line_count = 0;
 	
-	FILE *fp;
-	if ((fp = fopen(filename, "r")) == NULL) return -1;
+	XSTATS_SCOPE(XSTATS_FILE);
+	line_reader *r;
+	if ((r = line_reader_open(filename, 0)) == NULL) return -1;
 
+	const char *line;
 	char *s;
 	size_t s_len;
+	int keep_newline, rc;
 	
-	while (!feof(fp)) {
-		if ((s = (char *) calloc(LINE_MAX, sizeof(char))) == NULL) {
-			fclose(fp);
-			return -1;
-		}
+	while ((rc = line_reader_next(r, &line, &s_len)) > 0) {
+		if ((flags & FILE_SKIP_EMPTY_LINES) && s_len == 0) continue;
 		
-		fgets(s, LINE_MAX, fp);
-		s_len = strlen(s);
-
-		if (!(flags & FILE_NO_FLAGS)) {
-			if ((flags & FILE_SKIP_EMPTY_LINES) && s_len == 0) {
-				free(s); s = NULL; continue;
-			}
-			
-			if ((flags & FILE_IGNORE_NEW_LINES) && s_len > 0)
-				if (s[s_len - 1] == '\n') s[s_len - 1] = '\0';
-		}
+		keep_newline = r->newline && !(flags & FILE_IGNORE_NEW_LINES);
+		if ((s = (char *) xalloc(a, s_len + keep_newline + 1)) == NULL) break;
+		
+		memcpy(s, line, s_len);
+		if (keep_newline) s[s_len++] = '\n';
+		s[s_len] = '\0';
 		
 		elements[line_count] = s;
 		line_count++;
 	}
 	
-	fclose(fp);
+	line_reader_close(r);
+	
+	if (rc != 0) { split_free_a(a, elements, line_count); return -1; }
 	
 	return line_count;
 }
@@ -132,7 +137,7 @@ static void _filesize_dir_walk(const char *path, long int *s) {
 	if ((dir = opendir(_path)) != NULL) {
 		while ((df = readdir(dir)) != NULL) {
 			if (strcmp(df->d_name, ".") == 0 || strcmp(df->d_name, "..") == 0) continue;
-			sprintf(_dirent_path, "%s/%s", _path, df->d_name);
+			if (snprintf(_dirent_path, sizeof(_dirent_path), "%s/%s", _path, df->d_name) >= (int)sizeof(_dirent_path)) continue;
 			if (stat(_dirent_path, &fs) != -1) {
 				if (fs.st_mode & S_IFDIR)
 					_filesize_dir_walk(_dirent_path, s);
@@ -150,6 +155,7 @@ static void _filesize_dir_walk(const char *path, long int *s) {
 long long filesize(const char *path) {
 	long int size = 0;
 	struct stat fbuf;
+	XSTATS_SCOPE(XSTATS_FILESIZE);
 	if (stat(path, &fbuf) == -1) return -1;
 	if (fbuf.st_mode & S_IFDIR) {
 		_filesize_dir_walk(path, &size);
@@ -158,6 +164,122 @@ long long filesize(const char *path) {
 	return fbuf.st_size;
 }
 
+/**
+ * Calls callback for every line in a file, without the trailing newline.
+ * The line is only valid during the callback; a nonzero return stops the walk.
+ * @return the number of lines visited, -1 on error
+ */
+long long file_foreach_line(const char *path, int (*callback)(const char *line, size_t len, void *arg), void *arg) {
+	line_reader *r;
+	if ((r = line_reader_open(path, 0)) == NULL) return -1;
+	
+	const char *line;
+	size_t len;
+	long long count = 0;
+	int rc;
+	
+	while ((rc = line_reader_next(r, &line, &len)) > 0) {
+		count++;
+		if (callback(line, len, arg) != 0) break;
+	}
+	
+	line_reader_close(r);
+	
+	return rc < 0 ? -1 : count;
+}
+
+/**
+ * Opens a streaming line reader on a file.
+ * @param bufsize size of the read buffer, 0 for LINE_READER_BUFSIZE
+ * @return NULL on error
+ */
+line_reader *line_reader_open(const char *path, size_t bufsize) {
+	int fd;
+	line_reader *r;
+	if ((fd = open(path, O_RDONLY, 0)) == -1) return NULL;
+	if ((r = line_reader_fdopen(fd, bufsize)) == NULL) { close(fd); return NULL; }
+	r->owns_fd = 1;
+	return r;
+}
+
+/**
+ * Wraps an already open descriptor, which is left open by line_reader_close()
+ */
+line_reader *line_reader_fdopen(int fd, size_t bufsize) {
+	line_reader *r;
+	if (bufsize == 0) bufsize = LINE_READER_BUFSIZE;
+	if ((r = (line_reader *) malloc(sizeof(line_reader))) == NULL) return NULL;
+	if ((r->buf = (char *) malloc(bufsize)) == NULL) { free(r); return NULL; }
+	r->fd = fd;
+	r->owns_fd = 0;
+	r->size = bufsize;
+	r->start = r->scan = r->end = 0;
+	r->eof = 0;
+	r->newline = 0;
+	return r;
+}
+
+/**
+ * Fetches the next line as a view into the reader's buffer, without the
+ * trailing newline. The view stays valid until the next call.
+ * @return 1 if a line was read, 0 at end of file, -1 on error
+ */
+int line_reader_next(line_reader *r, const char **line, size_t *len) {
+	char *nl;
+	ssize_t n;
+	
+	for (;;) {
+		if (r->scan < r->end && (nl = (char *) memchr(r->buf + r->scan, '\n', r->end - r->scan)) != NULL) {
+			*line = r->buf + r->start;
+			*len = nl - *line;
+			r->start = r->scan = nl - r->buf + 1;
+			r->newline = 1;
+			return 1;
+		}
+		r->scan = r->end;
+		
+		if (r->eof) {
+			if (r->start == r->end) return 0;
+			/* last line with no newline at the end of the file */
+			*line = r->buf + r->start;
+			*len = r->end - r->start;
+			r->start = r->scan = r->end;
+			r->newline = 0;
+			return 1;
+		}
+		
+		/* keep the partial line and refill behind it */
+		if (r->start > 0) {
+			memmove(r->buf, r->buf + r->start, r->end - r->start);
+			r->end -= r->start;
+			r->scan -= r->start;
+			r->start = 0;
+		}
+		
+		/* a single line is larger than the buffer */
+		if (r->end == r->size) {
+			char *grown;
+			if ((grown = (char *) realloc(r->buf, r->size * 2)) == NULL) return -1;
+			r->buf = grown;
+			r->size *= 2;
+		}
+		
+		if ((n = read(r->fd, r->buf + r->end, r->size - r->end)) == -1) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		if (n == 0) r->eof = 1;
+		r->end += n;
+	}
+}
+
+void line_reader_close(line_reader *r) {
+	if (r == NULL) return;
+	if (r->owns_fd) close(r->fd);
+	free(r->buf);
+	free(r);
+}
+
 /**
  * Copies a file from source to destination, then removing the source
  * @return 1 if the copy is a success, 0 if not
@@ -172,15 +294,23 @@ int move(char *source, char *dest) {
 }
 
 long long readfile(const char *path, FILE *des) {
-	FILE *fp;
-	if ((fp = fopen(path, "r")) == NULL) return -1;
-	char s[LINE_MAX];
-	while (!(feof(fp))) {
-		memset(s, 0, LINE_MAX);
-		fgets(s, LINE_MAX, fp);/* in --to-> out */fputs(s, des);
-		if (ferror(fp) != 0) return -1;
+	int fd;
+	if ((fd = open(path, O_RDONLY, 0)) == -1) return -1;
+	
+	char s[64 * KB];
+	ssize_t n;
+	long long total = 0;
+	
+	while ((n = read(fd, s, sizeof(s))) != 0) {
+		if (n == -1) {
+			if (errno == EINTR) continue;
+			close(fd);
+			return -1;
+		}
+		/* in --to-> out */
+		if (fwrite(s, 1, n, des) != (size_t)n) { close(fd); return -1; }
+		total += n;
 	}
-	fclose(fp);
-	return filesize(path);
+	close(fd);
+	return total;
 }
-
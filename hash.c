@@ -7,11 +7,31 @@
 
 #include "xstdlib.h"
 
-unsigned int hash(const char *s) {
-	unsigned int hashval;
-	for (hashval = 0; *s != '\0'; s++)
-		hashval = *s + 31 * hashval;
-	return hashval % HASHSIZE;
+/**
+ * A 64-bit hash of len bytes, read eight at a time
+ */
+uint64_t hash_bytes64(const void *data, size_t len) {
+	const char *s = (const char *)data;
+	uint64_t h = 0x9E3779B97F4A7C15ULL ^ len, w;
+	while (len >= 8) {
+		memcpy(&w, s, 8);
+		h = (h ^ w) * 0xFF51AFD7ED558CCDULL;
+		h ^= h >> 32;
+		s += 8;
+		len -= 8;
+	}
+	if (len > 0) {
+		w = 0;
+		memcpy(&w, s, len);
+		h = (h ^ w) * 0xFF51AFD7ED558CCDULL;
+	}
+	h ^= h >> 29;
+	h *= 0xC4CEB9FE1A85EC53ULL;
+	return h ^ (h >> 32);
+}
+
+unsigned int hash_bytes(const void *data, size_t len) {
+	return (unsigned int)hash_bytes64(data, len);
 }
 
 void hash_init(hashtab *h[]) {
@@ -21,25 +41,92 @@ void hash_init(hashtab *h[]) {
 hashtab *hash_get(hashtab *h[], const char *key) {
 	unsigned int hashval = hash(key);
 	hashtab *entry;
+	XSTATS_SCOPE(XSTATS_HASH_GET);
 	for (entry = h[hashval]; entry != NULL; entry = entry->next) {
-		if (strcmp(key, entry->key) == 0)
+		XSTATS_PROBE();
+		if (entry->key == key || strcmp(key, entry->key) == 0)
 			return entry;
 	}
 	return NULL;
 }
 
-hashtab *hash_set(hashtab *h[], const char *key, void *val, unsigned short type, void (*destroy)(void *v), void (*print)(void *v)) {
+/**
+ * Looks up a key returned by intern() by pointer, without comparing strings
+ */
+hashtab *hash_get_interned(hashtab *h[], const char *ikey) {
+	hashtab *entry;
+	for (entry = h[hash(ikey)]; entry != NULL; entry = entry->next) {
+		if (entry->key == ikey)
+			return entry;
+	}
+	return NULL;
+}
+
+/**
+ * Looks up n keys, setting out[i] to keys[i]'s entry or NULL, and returns
+ * how many were found. Up to HASH_BATCH lookups walk their chains at once,
+ * one entry each per round with the next one prefetched, so their cache
+ * misses overlap instead of following one after another. A lookup that
+ * ends hands its place to the next key.
+ */
+size_t hash_get_many(hashtab *h[], const char *const keys[], size_t n, hashtab *out[]) {
+	hashtab *entry[HASH_BATCH];
+	size_t key[HASH_BATCH], next = 0, found = 0;
+	int i, active = 0;
+
+	XSTATS_SCOPE(XSTATS_HASH_GET_MANY);
+	for (i = 0; i < HASH_BATCH; i++) {
+		if (next == n) { entry[i] = NULL; key[i] = n; continue; }
+		key[i] = next;
+		__builtin_prefetch(entry[i] = h[hash(keys[next++])]);
+		active++;
+	}
+	while (active > 0) {
+		for (i = 0; i < HASH_BATCH; i++) {
+			if (key[i] == n) continue;
+			if (entry[i] != NULL && entry[i]->key != keys[key[i]] && strcmp(keys[key[i]], entry[i]->key) != 0) {
+				__builtin_prefetch(entry[i] = entry[i]->next);
+				continue;
+			}
+			found += (out[key[i]] = entry[i]) != NULL;
+			if (next < n) {
+				key[i] = next;
+				__builtin_prefetch(entry[i] = h[hash(keys[next++])]);
+			} else {
+				key[i] = n;
+				active--;
+			}
+		}
+	}
+	return found;
+}
+
+/**
+ * Sets the value of an existing entry or adds a new one. Interned keys are
+ * referenced, others are copied into the entry right behind it.
+ */
+static hashtab *_hash_set(const xallocator *a, hashtab *h[], const char *key, int interned, void *val, unsigned short type, void (*destroy)(void *v), void (*print)(void *v)) {
 	hashtab *n;
 	unsigned int hashval;
+	size_t key_size;
+	XSTATS_SCOPE(XSTATS_HASH_SET);
 	if ((n = hash_get(h, key)) == NULL) {
-		if ((n = (hashtab *)malloc(sizeof(hashtab))) == NULL)
+		key_size = interned ? 0 : strlen(key) + 1;
+		if ((n = (hashtab *)xalloc(a, sizeof(hashtab) + key_size)) == NULL)
 			return NULL;
+		n->allocator = a;
 		hashval = hash(key);
 		n->next = h[hashval];
-		strcpy(n->key, key);
+		if (interned) {
+			n->key = key;
+		} else {
+			memcpy(n->keybuf, key, key_size);
+			n->key = n->keybuf;
+		}
 		n->val  = val;
 		n->type = type;
 		n->destroy = destroy;
+		n->print = print;
 		h[hashval] = n;
 	} else {
 		if (n->destroy != NULL) n->destroy(n->val);
@@ -49,11 +136,39 @@ hashtab *hash_set(hashtab *h[], const char *key, void *val, unsigned short type,
 	return n;
 }
 
+hashtab *hash_set(hashtab *h[], const char *key, void *val, unsigned short type, void (*destroy)(void *v), void (*print)(void *v)) {
+	return _hash_set(NULL, h, key, 0, val, type, destroy, print);
+}
+
+/**
+ * hash_set() with a new entry taken from allocator a (NULL for the default)
+ */
+hashtab *hash_set_a(const xallocator *a, hashtab *h[], const char *key, void *val, unsigned short type, void (*destroy)(void *v), void (*print)(void *v)) {
+	return _hash_set(a, h, key, 0, val, type, destroy, print);
+}
+
+/**
+ * hash_set() for a key returned by intern(); the entry points at the key
+ * instead of copying it, so the pool must outlive the table
+ */
+hashtab *hash_set_interned(hashtab *h[], const char *ikey, void *val, unsigned short type, void (*destroy)(void *v), void (*print)(void *v)) {
+	return _hash_set(NULL, h, ikey, 1, val, type, destroy, print);
+}
+
+/**
+ * Removes the entry for key, destroying its value and freeing the entry
+ */
 void hash_unset(hashtab *h[], const char *key) {
-	hashtab *n, *next;
-	if ((n = hash_get(h, key)) != NULL) {
-		if (n->destroy != NULL) n->destroy(n->val);
-		else n->val = NULL;
+	hashtab **link, *n;
+	XSTATS_SCOPE(XSTATS_HASH_UNSET);
+	for (link = &h[hash(key)]; (n = *link) != NULL; link = &n->next) {
+		XSTATS_PROBE();
+		if (n->key == key || strcmp(key, n->key) == 0) {
+			*link = n->next;
+			if (n->destroy != NULL) n->destroy(n->val);
+			xalloc_free(n->allocator, n);
+			return;
+		}
 	}
 }
 
@@ -64,40 +179,226 @@ void hash_destroy(hashtab *h[], unsigned int size) {
 		for (entry = h[i]; entry != NULL; entry = next) {
 			if (entry->destroy != NULL) entry->destroy(entry->val);
 			next = entry->next;
-			free(entry); entry = NULL;
+			xalloc_free(entry->allocator, entry); entry = NULL;
 		}
 	}
 }
 
 void hash_print(hashtab *h[], unsigned int size) {
-	int i;
-	hashtab *entry, *next;
-	printf("{ ");
-	for (i = 0; i < size; i++) {
-		for (entry = h[i]; entry != NULL; entry = next) {
-			if (entry->print == NULL) {
-				switch (entry->type) {
-					case CHAR: printf("\"%s\" : '%c',", entry->key, *((char *)entry->val)); break;
-					case STRING: printf("\"%s\" : \"%s\",", entry->key, (char *)entry->val); break;
-					case SHORT: printf("\"%s\" : %d,", entry->key, *((short *)entry->val)); break;
-					case USHORT: printf("\"%s\" : %u,", entry->key, *((unsigned short *)entry->val)); break;
-					case INT: printf("\"%s\" : %d,", entry->key, *((int *)entry->val)); break;
-					case UINT: printf("\"%s\" : %u,", entry->key, *((unsigned int *)entry->val)); break;
-					case LONG: printf("\"%s\" : %ld,", entry->key, *((long *)entry->val)); break;
-					case ULONG: printf("\"%s\" : %lu,", entry->key, *((unsigned long *)entry->val)); break;
-					case LONGLONG: printf("\"%s\" : %lld,", entry->key, *((long long *)entry->val)); break;
-					case ULONGLONG: printf("\"%s\" : %llu,", entry->key, *((unsigned long long *)entry->val)); break;
-					case FLOAT: printf("\"%s\" : %.8f,", entry->key, *((float *)entry->val)); break;
-					case DOUBLE: printf("\"%s\" : %.16f,", entry->key, *((double *)entry->val)); break;
-					case LONGDOUBLE: printf("\"%s\" : %.16Lf,", entry->key, *((long double *)entry->val)); break;
-				}
+	xwriter w;
+	fflush(stdout);
+	xwriter_fd(&w, STDOUT_FILENO, 0);
+	hash_serialize(&w, h, size, XSERIAL_PRINT_CALLBACKS);
+	xwriter_putc(&w, '\n');
+	xwriter_close(&w);
+}
+
+/*
+ * hash_cache: a hash table whose entries are also threaded on a list from
+ * most to least recently used, so the entry to evict is always at the tail.
+ * The bucket array doubles as entries are added and every operation is
+ * O(1) on average.
+ */
+
+static long long _hash_cache_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void _hash_cache_unlink(hash_cache *c, hash_cache_entry *e) {
+	if (e->newer != NULL) e->newer->older = e->older;
+	else c->newest = e->older;
+	if (e->older != NULL) e->older->newer = e->newer;
+	else c->oldest = e->newer;
+}
+
+static void _hash_cache_push(hash_cache *c, hash_cache_entry *e) {
+	e->newer = NULL;
+	e->older = c->newest;
+	if (c->newest != NULL) c->newest->newer = e;
+	c->newest = e;
+	if (c->oldest == NULL) c->oldest = e;
+}
+
+static hash_cache_entry **_hash_cache_find(hash_cache *c, const char *key, size_t len, unsigned int hashval) {
+	hash_cache_entry **link, *e;
+	for (link = &c->buckets[hashval & (c->nbuckets - 1)]; (e = *link) != NULL; link = &e->next)
+		if (e->hashval == hashval && e->key_len == len && memcmp(e->key, key, len) == 0) break;
+	return link;
+}
+
+/**
+ * Unlinks the entry at *link from the table and the recency list, destroys
+ * its value and frees it
+ */
+static void _hash_cache_remove(hash_cache *c, hash_cache_entry **link) {
+	hash_cache_entry *e = *link;
+	*link = e->next;
+	_hash_cache_unlink(c, e);
+	c->size--;
+	c->bytes -= e->bytes;
+	if (e->destroy != NULL) e->destroy(e->val);
+	xalloc_free(c->allocator, e);
+}
+
+static void _hash_cache_grow(hash_cache *c) {
+	hash_cache_entry **buckets, *e, *next;
+	size_t n = c->nbuckets * 2, i;
+
+	/* a failed grow only makes the chains longer */
+	if ((buckets = (hash_cache_entry **)xalloc_zero(c->allocator, n, sizeof(hash_cache_entry *))) == NULL) return;
+	for (i = 0; i < c->nbuckets; i++) {
+		for (e = c->buckets[i]; e != NULL; e = next) {
+			next = e->next;
+			e->next = buckets[e->hashval & (n - 1)];
+			buckets[e->hashval & (n - 1)] = e;
+		}
+	}
+	xalloc_free(c->allocator, c->buckets);
+	c->buckets = buckets;
+	c->nbuckets = n;
+}
+
+hash_cache *hash_cache_init(size_t max_entries, size_t max_bytes) {
+	return hash_cache_init_a(NULL, max_entries, max_bytes);
+}
+
+/**
+ * Creates a cache holding at most max_entries entries and max_bytes bytes,
+ * either limit being off when 0. Entries come from allocator a.
+ */
+hash_cache *hash_cache_init_a(const xallocator *a, size_t max_entries, size_t max_bytes) {
+	hash_cache *c;
+	if ((c = (hash_cache *)xalloc_zero(a, 1, sizeof(hash_cache))) == NULL) return NULL;
+	c->nbuckets = HASH_CACHE_MIN_BUCKETS;
+	if ((c->buckets = (hash_cache_entry **)xalloc_zero(a, c->nbuckets, sizeof(hash_cache_entry *))) == NULL) {
+		xalloc_free(a, c);
+		return NULL;
+	}
+	c->allocator = a;
+	c->max_entries = max_entries;
+	c->max_bytes = max_bytes;
+	return c;
+}
+
+/**
+ * Returns the live entry for key and marks it most recently used, NULL on
+ * a miss. An expired entry is removed and counts as a miss.
+ */
+hash_cache_entry *hash_cache_get(hash_cache *c, const char *key) {
+	hash_cache_entry **link, *e;
+	size_t len;
+
+	XSTATS_SCOPE(XSTATS_HASH_CACHE_GET);
+	len = strlen(key);
+	link = _hash_cache_find(c, key, len, hash_bytes(key, len));
+	e = *link;
+	if (e != NULL && e->expires != 0 && e->expires <= _hash_cache_now()) {
+		_hash_cache_remove(c, link);
+		c->expirations++;
+		e = NULL;
+	}
+	if (e == NULL) {
+		c->misses++;
+		return NULL;
+	}
+	c->hits++;
+	if (c->newest != e) {
+		_hash_cache_unlink(c, e);
+		_hash_cache_push(c, e);
+	}
+	return e;
+}
+
+/**
+ * Adds key or replaces its value, then evicts least recently used entries
+ * until the cache is back within its limits. bytes is what the value costs
+ * against max_bytes, on top of the key; ttl_ms is how long the entry lives,
+ * 0 for ever. The new entry itself is never evicted. NULL if out of memory.
+ */
+hash_cache_entry *hash_cache_set(hash_cache *c, const char *key, void *val, unsigned short type, void (*destroy)(void *v), size_t bytes, long long ttl_ms) {
+	hash_cache_entry **link, *e;
+	unsigned int hashval;
+	size_t len;
+
+	XSTATS_SCOPE(XSTATS_HASH_CACHE_SET);
+	len = strlen(key);
+	hashval = hash_bytes(key, len);
+	link = _hash_cache_find(c, key, len, hashval);
+	e = *link;
+	if (e != NULL) {
+		if (e->destroy != NULL) e->destroy(e->val);
+		c->bytes -= e->bytes;
+		_hash_cache_unlink(c, e);
+	} else {
+		if ((e = (hash_cache_entry *)xalloc(c->allocator, sizeof(hash_cache_entry) + len + 1)) == NULL) return NULL;
+		memcpy(e->key, key, len + 1);
+		e->key_len = len;
+		e->hashval = hashval;
+		e->next = *link;
+		*link = e;
+		if (++c->size > c->nbuckets) _hash_cache_grow(c);
+	}
+	e->val = val;
+	e->type = type;
+	e->destroy = destroy;
+	e->bytes = bytes + len;
+	e->expires = ttl_ms > 0 ? _hash_cache_now() + ttl_ms : 0;
+	c->bytes += e->bytes;
+	_hash_cache_push(c, e);
+
+	while (c->oldest != e && ((c->max_entries > 0 && c->size > c->max_entries) || (c->max_bytes > 0 && c->bytes > c->max_bytes))) {
+		hash_cache_entry *old = c->oldest;
+		_hash_cache_remove(c, _hash_cache_find(c, old->key, old->key_len, old->hashval));
+		c->evictions++;
+	}
+	return e;
+}
+
+/**
+ * Removes key, returns 1 if it was there
+ */
+int hash_cache_unset(hash_cache *c, const char *key) {
+	size_t len = strlen(key);
+	hash_cache_entry **link = _hash_cache_find(c, key, len, hash_bytes(key, len));
+	if (*link == NULL) return 0;
+	_hash_cache_remove(c, link);
+	return 1;
+}
+
+/**
+ * Removes every expired entry, returns how many there were
+ */
+size_t hash_cache_purge(hash_cache *c) {
+	long long now = _hash_cache_now();
+	hash_cache_entry **link;
+	size_t i, n = 0;
+	for (i = 0; i < c->nbuckets; i++) {
+		for (link = &c->buckets[i]; *link != NULL;) {
+			if ((*link)->expires != 0 && (*link)->expires <= now) {
+				_hash_cache_remove(c, link);
+				n++;
 			} else {
-				entry->print(entry);
+				link = &(*link)->next;
 			}
-			next = entry->next;
 		}
 	}
-	printf(" }\n");
+	c->expirations += n;
+	return n;
 }
 
+void hash_cache_clear(hash_cache *c) {
+	size_t i;
+	for (i = 0; i < c->nbuckets; i++)
+		while (c->buckets[i] != NULL) _hash_cache_remove(c, &c->buckets[i]);
+}
 
+void hash_cache_destroy(hash_cache *c) {
+	const xallocator *a;
+	if (c == NULL) return;
+	a = c->allocator;
+	hash_cache_clear(c);
+	xalloc_free(a, c->buckets);
+	xalloc_free(a, c);
+}
@@ -0,0 +1,165 @@
+/********************************************************************
+ * Name: heap.c
+ * Author: rashaudteague
+ * License: GNU LGPL <http://www.gnu.org/licenses/>
+ * Description: An array-backed d-ary heap priority queue
+ ********************************************************************/
+
+#include "xstdlib.h"
+
+/*
+ * Children of slot i are i * arity + 1 ... i * arity + arity. A wider node
+ * makes the tree shallower and keeps a node's children in one or two cache
+ * lines, which pays off on pop where every level compares all of them.
+ */
+
+static long double _heap_number(const heap_slot *s) {
+	switch (s->type) {
+		case CHAR:       return *(char *)s->data;
+		case SHORT:      return *(short *)s->data;
+		case USHORT:     return *(unsigned short *)s->data;
+		case INT:        return *(int *)s->data;
+		case UINT:       return *(unsigned int *)s->data;
+		case LONG:       return *(long *)s->data;
+		case ULONG:      return *(unsigned long *)s->data;
+		case LONGLONG:   return *(long long *)s->data;
+		case ULONGLONG:  return *(unsigned long long *)s->data;
+		case FLOAT:      return *(float *)s->data;
+		case DOUBLE:     return *(double *)s->data;
+		case LONGDOUBLE: return *(long double *)s->data;
+	}
+	return 0;
+}
+
+/**
+ * Orders by the values behind the __types__ tags: numbers numerically,
+ * STRINGs with strcmp() and VOID by address
+ */
+static int _heap_compare_typed(const heap_slot *a, const heap_slot *b) {
+	long double x, y;
+	if (a->type == STRING && b->type == STRING) return strcmp((char *)a->data, (char *)b->data);
+	if (a->type == VOID || b->type == VOID || a->type == STRING || b->type == STRING)
+		return (uintptr_t)a->data < (uintptr_t)b->data ? -1 : (uintptr_t)a->data > (uintptr_t)b->data;
+	x = _heap_number(a);
+	y = _heap_number(b);
+	return x < y ? -1 : x > y;
+}
+
+static int _heap_less(const heap *h, const heap_slot *a, const heap_slot *b) {
+	return (h->compare != NULL ? h->compare(a->data, b->data) : _heap_compare_typed(a, b)) < 0;
+}
+
+static void _heap_free_data(heap *h, heap_slot *s) {
+	if (h->destroy != NULL) h->destroy(s->data);
+	else if (s->memory_type == DYNAMIC) free(s->data);
+	s->data = NULL;
+}
+
+static void _heap_sift_up(heap *h, size_t i) {
+	heap_slot s = h->slots[i];
+	size_t parent;
+	while (i > 0) {
+		parent = (i - 1) / h->arity;
+		if (!_heap_less(h, &s, &h->slots[parent])) break;
+		h->slots[i] = h->slots[parent];
+		i = parent;
+	}
+	h->slots[i] = s;
+}
+
+static void _heap_sift_down(heap *h, size_t i) {
+	heap_slot s = h->slots[i];
+	size_t child, best, end;
+	for (;;) {
+		child = i * h->arity + 1;
+		if (child >= h->size) break;
+		end = child + h->arity < h->size ? child + h->arity : h->size;
+		for (best = child++; child < end; child++)
+			if (_heap_less(h, &h->slots[child], &h->slots[best])) best = child;
+		if (!_heap_less(h, &h->slots[best], &s)) break;
+		h->slots[i] = h->slots[best];
+		i = best;
+	}
+	h->slots[i] = s;
+}
+
+heap *heap_init(unsigned int arity, int (*compare)(const void *a, const void *b)) {
+	return heap_init_a(NULL, arity, compare);
+}
+
+/**
+ * Creates a min-heap of arity children per node (HEAP_ARITY below 2).
+ * compare(a, b) gets two elements' data and returns < 0 when a comes out
+ * first; with no comparator elements are ordered by their __types__ values.
+ * Slots come from allocator a; DYNAMIC data is malloc()ed and free()d.
+ */
+heap *heap_init_a(const xallocator *a, unsigned int arity, int (*compare)(const void *a, const void *b)) {
+	heap *h;
+	if ((h = (heap *)xalloc(a, sizeof(heap))) == NULL) return NULL;
+	if ((h->slots = (heap_slot *)xalloc(a, HEAP_MIN_CAPACITY * sizeof(heap_slot))) == NULL) { xalloc_free(a, h); return NULL; }
+	h->allocator = a;
+	h->arity = arity >= 2 ? arity : HEAP_ARITY;
+	h->compare = compare;
+	h->destroy = NULL;
+	h->size = 0;
+	h->cap = HEAP_MIN_CAPACITY;
+	return h;
+}
+
+/**
+ * Returns 1 on success, 0 if out of memory
+ */
+int heap_push(heap *h, void *data, unsigned short type, unsigned short memory_type) {
+	heap_slot *slots;
+	if (h->size == h->cap) {
+		if ((slots = (heap_slot *)xalloc_resize(h->allocator, h->slots, h->cap * sizeof(heap_slot), h->cap * 2 * sizeof(heap_slot))) == NULL) return 0;
+		h->slots = slots;
+		h->cap *= 2;
+	}
+	h->slots[h->size].data = data;
+	h->slots[h->size].type = type;
+	h->slots[h->size].memory_type = memory_type;
+	_heap_sift_up(h, h->size++);
+	return 1;
+}
+
+/**
+ * The data of the element that comes out first, NULL when empty
+ */
+void *heap_peek(const heap *h) {
+	return h->size > 0 ? h->slots[0].data : NULL;
+}
+
+/**
+ * Removes the first element and returns its data, which now belongs to the
+ * caller. NULL when empty.
+ */
+void *heap_pop(heap *h) {
+	void *data;
+	if (h->size == 0) return NULL;
+	data = h->slots[0].data;
+	if (--h->size > 0) {
+		h->slots[0] = h->slots[h->size];
+		_heap_sift_down(h, 0);
+	}
+	return data;
+}
+
+/**
+ * Removes every element, passing each one's data to the destroy callback
+ * or freeing it if it is DYNAMIC
+ */
+void heap_clear(heap *h) {
+	size_t i;
+	for (i = 0; i < h->size; i++) _heap_free_data(h, &h->slots[i]);
+	h->size = 0;
+}
+
+void heap_destroy(heap *h) {
+	const xallocator *a;
+	if (h == NULL) return;
+	a = h->allocator;
+	heap_clear(h);
+	xalloc_free(a, h->slots);
+	xalloc_free(a, h);
+}
@@ -0,0 +1,129 @@
+/********************************************************************
+ * Name: intern.c
+ * Author: rashaudteague
+ * License: GNU LGPL <http://www.gnu.org/licenses/>
+ * Description: String interning, one canonical copy per distinct string
+ ********************************************************************/
+
+#include "xstdlib.h"
+
+static int _intern_grow(intern_pool *p) {
+	intern_slot *slots;
+	size_t cap = p->cap * 2, i, j;
+
+	if ((slots = (intern_slot *)calloc(cap, sizeof(intern_slot))) == NULL) return 0;
+	XSTATS_BYTES(cap * sizeof(intern_slot));
+	for (i = 0; i < p->cap; i++) {
+		if (p->slots[i].str == NULL) continue;
+		for (j = p->slots[i].hash & (cap - 1); slots[j].str != NULL; j = (j + 1) & (cap - 1));
+		slots[j] = p->slots[i];
+	}
+	free(p->slots);
+	p->slots = slots;
+	p->cap = cap;
+	return 1;
+}
+
+/**
+ * Creates a pool sized for about capacity distinct strings. Not thread safe.
+ */
+intern_pool *intern_init(size_t capacity) {
+	intern_pool *p;
+	size_t cap = 16;
+
+	while (cap / 4 * 3 < capacity) cap <<= 1;
+	if ((p = (intern_pool *)malloc(sizeof(intern_pool))) == NULL) return NULL;
+	if ((p->strings = arena_init(INTERN_BLOCK_SIZE)) == NULL) { free(p); return NULL; }
+	if ((p->slots = (intern_slot *)calloc(cap, sizeof(intern_slot))) == NULL) {
+		arena_destroy(p->strings);
+		free(p);
+		return NULL;
+	}
+	p->cap = cap;
+	p->size = 0;
+	p->bytes = 0;
+	return p;
+}
+
+static intern_slot *_intern_find(intern_pool *p, const char *s, size_t len, uint32_t h) {
+	intern_slot *slot;
+	size_t i;
+	for (i = h & (p->cap - 1);; i = (i + 1) & (p->cap - 1)) {
+		slot = &p->slots[i];
+		if (slot->str == NULL) return slot;
+		if (slot->hash == h && slot->len == len && memcmp(slot->str, s, len) == 0) return slot;
+	}
+}
+
+/**
+ * Returns the canonical copy of the first len bytes of s, adding it if it
+ * is new. Equal strings always get the same pointer, which stays valid
+ * until intern_destroy(). NULL when out of memory.
+ */
+const char *intern_n(intern_pool *p, const char *s, size_t len) {
+	uint32_t h;
+	intern_slot *slot;
+	char *copy;
+
+	XSTATS_SCOPE(XSTATS_INTERN);
+	if (len > UINT32_MAX) return NULL;
+	h = hash_bytes(s, len);
+	slot = _intern_find(p, s, len, h);
+	if (slot->str != NULL) return slot->str;
+
+	if ((p->size + 1) > p->cap / 4 * 3) {
+		if (!_intern_grow(p)) return NULL;
+		slot = _intern_find(p, s, len, h);
+	}
+	if ((copy = (char *)arena_alloc(p->strings, len + 1)) == NULL) return NULL;
+	XSTATS_BYTES(len + 1);
+	memcpy(copy, s, len);
+	copy[len] = '\0';
+	slot->str = copy;
+	slot->hash = h;
+	slot->len = (uint32_t)len;
+	p->size++;
+	p->bytes += len + 1;
+	return copy;
+}
+
+const char *intern(intern_pool *p, const char *s) {
+	return intern_n(p, s, strlen(s));
+}
+
+/**
+ * The canonical copy of s if it has been interned, otherwise NULL
+ */
+const char *intern_lookup(intern_pool *p, const char *s) {
+	size_t len = strlen(s);
+	return _intern_find(p, s, len, hash_bytes(s, len))->str;
+}
+
+void intern_destroy(intern_pool *p) {
+	if (p == NULL) return;
+	arena_destroy(p->strings);
+	free(p->slots);
+	free(p);
+}
+
+/**
+ * split() returning interned tokens: repeated tokens share one copy and the
+ * elements must not be freed. Returns the number of elements; stops early
+ * if out of memory.
+ */
+int split_intern(intern_pool *p, const char *delimiter, const char *s, const char *elements[]) {
+	size_t delimiter_len = strlen(delimiter), x;
+	const char *start = s, *d;
+	int e = 0;
+
+	if (delimiter_len == 0) return 0;
+	for (;;) {
+		d = strstr(start, delimiter);
+		x = d != NULL ? (size_t)(d - start) : strlen(start);
+		if ((elements[e] = intern_n(p, start, x)) == NULL) return e;
+		e++;
+		if (d == NULL) break;
+		start = d + delimiter_len;
+	}
+	return e;
+}
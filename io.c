@@ -8,13 +8,508 @@
 
 #include "xstdlib.h"
 
+/*
+ * xlog keeps one single-producer/single-consumer ring per logging thread.
+ * The hot path only copies the format pointer and the raw arguments into
+ * the ring; a background thread does the formatting and the write().
+ */
+
+typedef union __xlog_arg__ {
+	long long i;
+	unsigned long long u;
+	double d;
+	long double ld;
+	const void *p;
+	size_t s;     /* offset of a copied string in the record's text */
+} _xlog_arg;
+
+typedef struct __xlog_record__ {
+	const char *format;
+	struct timespec ts;
+	unsigned short level;
+	unsigned short nargs;
+	unsigned short used;
+	_xlog_arg args[XLOG_MAX_ARGS];
+	char text[XLOG_TEXT_SIZE];
+} _xlog_record;
+
+typedef struct __xlog_ring__ {
+	unsigned long head;   /* next record to consume, written by the writer thread */
+	char _pad[64 - sizeof(unsigned long)];
+	unsigned long tail;   /* next record to produce, written by the owning thread */
+	unsigned int mask;
+	int closed;           /* the owning thread has exited */
+	int orphaned;         /* left to the owning thread to free by xlog_shutdown() */
+	struct __xlog_ring__ *next;
+	_xlog_record *records;
+} _xlog_ring;
+
+typedef struct __xlog_spec__ {
+	const char *start;    /* the '%' */
+	const char *end;      /* one past the conversion character */
+	char conv;
+	char length;          /* 'H' for hh, 'q' for ll, otherwise the modifier itself */
+	unsigned char stars;
+} _xlog_spec;
+
+#define XLOG_NULL_STRING ((size_t)-1)
+
+static struct {
+	int fd;
+	unsigned short level;
+	unsigned short policy;
+	unsigned int ring_size;
+	unsigned int generation;
+	int running;
+	unsigned long long dropped;
+	unsigned long flush_requested;
+	unsigned long flush_done;
+	_xlog_ring *rings;
+	pthread_t writer;
+	pthread_key_t key;
+	pthread_mutex_t lock;
+	pthread_cond_t flushed;
+} _xlog = { -1, XLOG_INFO, XLOG_DROP, 0, 0, 0, 0, 0, 0, NULL,
+	/* never re-initialised, threads holding orphaned rings may be using them */
+	.lock = PTHREAD_MUTEX_INITIALIZER, .flushed = PTHREAD_COND_INITIALIZER };
+
+static pthread_once_t _xlog_key_once = PTHREAD_ONCE_INIT;
+static __thread _xlog_ring *_xlog_local = NULL;
+static __thread unsigned int _xlog_local_generation = 0;
+
+static const char *_xlog_level_names[] = { "DEBUG", "INFO", "WARN", "ERROR", "FATAL" };
+
+static const char *_xlog_parse_spec(const char *p, _xlog_spec *spec) {
+	spec->start = p++;
+	spec->stars = 0;
+	spec->length = 0;
+	while (*p != '\0' && strchr("-+ #0'", *p) != NULL) p++;
+	if (*p == '*') { spec->stars++; p++; } else while (isdigit((unsigned char)*p)) p++;
+	if (*p == '.') {
+		p++;
+		if (*p == '*') { spec->stars++; p++; } else while (isdigit((unsigned char)*p)) p++;
+	}
+	switch (*p) {
+		case 'h': spec->length = 'h'; if (*++p == 'h') { spec->length = 'H'; p++; } break;
+		case 'l': spec->length = 'l'; if (*++p == 'l') { spec->length = 'q'; p++; } break;
+		case 'L': case 'j': case 'z': case 't': spec->length = *p++; break;
+	}
+	spec->conv = *p;
+	spec->end = *p != '\0' ? p + 1 : p;
+	return spec->end;
+}
+
+/* pulls every argument the format asks for off the va_list, copying strings */
+static void _xlog_capture(_xlog_record *r, const char *format, va_list ap) {
+	const char *p = format;
+	_xlog_spec spec;
+	int i;
+
+	r->nargs = 0;
+	r->used = 0;
+	while ((p = strchr(p, '%')) != NULL) {
+		if (p[1] == '%') { p += 2; continue; }
+		p = _xlog_parse_spec(p, &spec);
+		if (r->nargs + spec.stars + 1 > XLOG_MAX_ARGS) return;
+		for (i = 0; i < spec.stars; i++) r->args[r->nargs++].i = va_arg(ap, int);
+
+		switch (spec.conv) {
+			case 'd': case 'i':
+				switch (spec.length) {
+					case 'H': r->args[r->nargs].i = (signed char)va_arg(ap, int); break;
+					case 'h': r->args[r->nargs].i = (short)va_arg(ap, int); break;
+					case 'l': r->args[r->nargs].i = va_arg(ap, long); break;
+					case 'q': r->args[r->nargs].i = va_arg(ap, long long); break;
+					case 'j': r->args[r->nargs].i = va_arg(ap, intmax_t); break;
+					case 'z': r->args[r->nargs].i = va_arg(ap, ssize_t); break;
+					case 't': r->args[r->nargs].i = va_arg(ap, ptrdiff_t); break;
+					default:  r->args[r->nargs].i = va_arg(ap, int); break;
+				}
+				break;
+			case 'u': case 'o': case 'x': case 'X': case 'c':
+				switch (spec.length) {
+					case 'H': r->args[r->nargs].u = (unsigned char)va_arg(ap, unsigned int); break;
+					case 'h': r->args[r->nargs].u = (unsigned short)va_arg(ap, unsigned int); break;
+					case 'l': r->args[r->nargs].u = va_arg(ap, unsigned long); break;
+					case 'q': r->args[r->nargs].u = va_arg(ap, unsigned long long); break;
+					case 'j': r->args[r->nargs].u = va_arg(ap, uintmax_t); break;
+					case 'z': r->args[r->nargs].u = va_arg(ap, size_t); break;
+					case 't': r->args[r->nargs].u = va_arg(ap, ptrdiff_t); break;
+					default:  r->args[r->nargs].u = va_arg(ap, unsigned int); break;
+				}
+				break;
+			case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+				if (spec.length == 'L') r->args[r->nargs].ld = va_arg(ap, long double);
+				else r->args[r->nargs].d = va_arg(ap, double);
+				break;
+			case 's': {
+				/* the caller's string may be gone by the time it is formatted */
+				const char *s = va_arg(ap, const char *);
+				size_t room = XLOG_TEXT_SIZE - r->used, n;
+				if (s == NULL) { r->args[r->nargs].s = XLOG_NULL_STRING; break; }
+				if (room == 0) { r->args[r->nargs].s = XLOG_TEXT_SIZE - 1; break; }
+				n = strnlen(s, room - 1);
+				memcpy(r->text + r->used, s, n);
+				r->text[r->used + n] = '\0';
+				r->args[r->nargs].s = r->used;
+				r->used += n + 1;
+				break;
+			}
+			case 'p':
+				r->args[r->nargs].p = va_arg(ap, void *);
+				break;
+			case 'n':
+				/* never written through, it is printed literally */
+				(void)va_arg(ap, void *);
+				continue;
+			default:
+				continue;
+		}
+		r->nargs++;
+	}
+}
+
+/* formats one record into buffer, returns the length written */
+static size_t _xlog_render(_xlog_record *r, char *buffer, size_t size, time_t *last_sec, char *stamp) {
+	const char *p = r->format, *next;
+	_xlog_spec spec;
+	char fmt[64];
+	size_t len, n, flen;
+	int a = 0, stars[2] = { 0, 0 }, i;
+	struct tm tm;
+
+	if (r->ts.tv_sec != *last_sec) {
+		localtime_r(&r->ts.tv_sec, &tm);
+		strftime(stamp, 32, "%Y-%m-%d %H:%M:%S", &tm);
+		*last_sec = r->ts.tv_sec;
+	}
+	len = snprintf(buffer, size, "%s.%06ld [%s] ", stamp, r->ts.tv_nsec / 1000, _xlog_level_names[r->level]);
+
+	while (len < size - 1 && *p != '\0') {
+		if ((next = strchr(p, '%')) == NULL) next = p + strlen(p);
+		n = next - p;
+		if (n > size - 1 - len) n = size - 1 - len;
+		memcpy(buffer + len, p, n);
+		len += n;
+		if (*next == '\0') break;
+		if (next[1] == '%') { buffer[len++] = '%'; p = next + 2; continue; }
+
+		p = _xlog_parse_spec(next, &spec);
+		if (spec.conv == '\0' || strchr("diuoxXceEfFgGaAsp", spec.conv) == NULL) {
+			/* %n and unknown conversions were not captured */
+			n = spec.end - next;
+			if (n > size - 1 - len) n = size - 1 - len;
+			memcpy(buffer + len, next, n);
+			len += n;
+			continue;
+		}
+		if (a + spec.stars >= r->nargs) {
+			/* out of captured arguments, print the rest as it is */
+			n = strlen(next);
+			if (n > size - 1 - len) n = size - 1 - len;
+			memcpy(buffer + len, next, n);
+			len += n;
+			break;
+		}
+
+		/* rebuild the spec with a length modifier matching the captured type */
+		flen = 0;
+		for (next = spec.start; next < spec.end - 1 && flen < sizeof(fmt) - 4; next++)
+			if (strchr("hlLjzt", *next) == NULL) fmt[flen++] = *next;
+		if (strchr("diuoxX", spec.conv) != NULL) { fmt[flen++] = 'l'; fmt[flen++] = 'l'; }
+		else if (spec.length == 'L' && strchr("eEfFgGaA", spec.conv) != NULL) fmt[flen++] = 'L';
+		fmt[flen++] = spec.conv;
+		fmt[flen] = '\0';
+
+		for (i = 0; i < spec.stars; i++) stars[i] = (int)r->args[a++].i;
+
+#define _XLOG_EMIT(value) \
+		(spec.stars == 0 ? snprintf(buffer + len, size - len, fmt, value) : \
+		 spec.stars == 1 ? snprintf(buffer + len, size - len, fmt, stars[0], value) : \
+		                   snprintf(buffer + len, size - len, fmt, stars[0], stars[1], value))
+
+		switch (spec.conv) {
+			case 'd': case 'i': n = _XLOG_EMIT(r->args[a].i); break;
+			case 'u': case 'o': case 'x': case 'X': n = _XLOG_EMIT(r->args[a].u); break;
+			case 'c': n = _XLOG_EMIT((int)r->args[a].u); break;
+			case 's': n = _XLOG_EMIT(r->args[a].s == XLOG_NULL_STRING ? "(null)" : r->text + r->args[a].s); break;
+			case 'p': n = _XLOG_EMIT(r->args[a].p); break;
+			default:
+				if (spec.length == 'L') n = _XLOG_EMIT(r->args[a].ld);
+				else n = _XLOG_EMIT(r->args[a].d);
+				break;
+		}
+#undef _XLOG_EMIT
+		a++;
+		len += n;
+		if (len > size - 1) len = size - 1;
+	}
+
+	if (len >= size - 1) len = size - 2;
+	if (len == 0 || buffer[len - 1] != '\n') buffer[len++] = '\n';
+	return len;
+}
+
+static void _xlog_write(const char *buffer, size_t len) {
+	ssize_t n;
+	while (len > 0) {
+		if ((n = write(_xlog.fd, buffer, len)) == -1) {
+			if (errno == EINTR) continue;
+			return;
+		}
+		buffer += n;
+		len -= n;
+	}
+}
+
+/* drains every ring once, returns the number of records written */
+static unsigned long _xlog_drain(char *out, size_t out_size) {
+	static time_t last_sec = -1;
+	static char stamp[32];
+	_xlog_ring *ring, **link;
+	unsigned long head, tail, count = 0;
+	size_t len = 0;
+
+	pthread_mutex_lock(&_xlog.lock);
+	link = &_xlog.rings;
+	while ((ring = *link) != NULL) {
+		pthread_mutex_unlock(&_xlog.lock);
+
+		head = ring->head;
+		tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+		for ( ; head != tail; head++, count++) {
+			if (out_size - len < 4 * KB) { _xlog_write(out, len); len = 0; }
+			len += _xlog_render(&ring->records[head & ring->mask], out + len, 4 * KB, &last_sec, stamp);
+			__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+		}
+
+		pthread_mutex_lock(&_xlog.lock);
+		/* rings pushed while unlocked went in ahead of this one */
+		if (*link != ring)
+			for (link = &_xlog.rings; *link != ring; link = &(*link)->next);
+		if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE) && ring->head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) {
+			*link = ring->next;
+			free(ring->records);
+			free(ring);
+		} else {
+			link = &ring->next;
+		}
+	}
+	pthread_mutex_unlock(&_xlog.lock);
+
+	if (len > 0) _xlog_write(out, len);
+	return count;
+}
+
+static void *_xlog_writer(void *arg) {
+	char *out = (char *)arg;
+	unsigned long requested;
+	int running, idle = 0;
+	struct timespec nap = { 0, 1000000 };
+
+	do {
+		pthread_mutex_lock(&_xlog.lock);
+		requested = _xlog.flush_requested;
+		running = _xlog.running;
+		pthread_mutex_unlock(&_xlog.lock);
+
+		if (_xlog_drain(out, 64 * KB) > 0) {
+			idle = 0;
+		} else if (requested == _xlog.flush_done && running) {
+			/* back off from spinning to napping while nothing is logged */
+			if (++idle > 64) nanosleep(&nap, NULL); else sched_yield();
+		}
+
+		if (requested != _xlog.flush_done) {
+			pthread_mutex_lock(&_xlog.lock);
+			_xlog.flush_done = requested;
+			pthread_cond_broadcast(&_xlog.flushed);
+			pthread_mutex_unlock(&_xlog.lock);
+		}
+	} while (running);
+
+	free(out);
+	return NULL;
+}
+
+static void _xlog_ring_free(_xlog_ring *ring) {
+	free(ring->records);
+	free(ring);
+}
+
+/* the writer frees a closed ring once drained, the owner one xlog_shutdown() orphaned */
+static void _xlog_thread_exit(void *arg) {
+	_xlog_ring *ring = (_xlog_ring *)arg;
+	pthread_mutex_lock(&_xlog.lock);
+	if (ring->orphaned) _xlog_ring_free(ring);
+	else __atomic_store_n(&ring->closed, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&_xlog.lock);
+}
+
+static void _xlog_key_init(void) {
+	pthread_key_create(&_xlog.key, _xlog_thread_exit);
+}
+
+static _xlog_ring *_xlog_ring_init(void) {
+	_xlog_ring *ring;
+	if ((ring = (_xlog_ring *)calloc(1, sizeof(_xlog_ring))) == NULL) return NULL;
+	if ((ring->records = (_xlog_record *)malloc(_xlog.ring_size * sizeof(_xlog_record))) == NULL) {
+		free(ring);
+		return NULL;
+	}
+	ring->mask = _xlog.ring_size - 1;
+
+	pthread_mutex_lock(&_xlog.lock);
+	if (_xlog_local != NULL) {
+		/* this thread's ring from before the last xlog_shutdown() */
+		_xlog_ring_free(_xlog_local);
+		_xlog_local = NULL;
+	}
+	ring->next = _xlog.rings;
+	_xlog.rings = ring;
+	pthread_mutex_unlock(&_xlog.lock);
+	pthread_setspecific(_xlog.key, ring);
+
+	return ring;
+}
+
 void die(const char *format, ...) {
 	va_list arg;
-	int done;
-	
+
+	xlog_flush();
+
 	va_start (arg, format);
-	done = vfprintf (stdout, format, arg);
+	vfprintf (stdout, format, arg);
 	va_end (arg);
-	
-	exit(EXIT_SUCCESS);
+
+	exit(EXIT_FAILURE);
+}
+
+/**
+ * Starts the background log writer.
+ * @param fd where formatted lines are written
+ * @param level records below this level are discarded by xlog()
+ * @param ring_size records per logging thread, rounded up to a power of 2
+ * @param policy XLOG_DROP or XLOG_BLOCK when a thread's ring is full
+ * @return 1 on success, 0 on failure
+ */
+int xlog_init(int fd, unsigned short level, unsigned int ring_size, unsigned short policy) {
+	char *out;
+	unsigned int size = 1;
+
+	if (_xlog.running) return 0;
+	if (ring_size == 0) ring_size = XLOG_RING_SIZE;
+	while (size < ring_size) size <<= 1;
+
+	_xlog.fd = fd;
+	_xlog.level = level;
+	_xlog.policy = policy;
+	_xlog.ring_size = size;
+	_xlog.generation++;
+	_xlog.dropped = 0;
+	_xlog.flush_requested = _xlog.flush_done = 0;
+	/* kept across xlog_shutdown(), threads may still hold orphaned rings */
+	pthread_once(&_xlog_key_once, _xlog_key_init);
+
+	if ((out = (char *)malloc(64 * KB)) == NULL) return 0;
+	_xlog.running = 1;
+	if (pthread_create(&_xlog.writer, NULL, _xlog_writer, out) != 0) {
+		_xlog.running = 0;
+		free(out);
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * Logs a printf style message without formatting it on the calling thread.
+ * Strings are copied (up to XLOG_TEXT_SIZE bytes per record), everything
+ * else is captured by value. Before xlog_init() messages go straight to stderr.
+ */
+void xlog(unsigned short level, const char *format, ...) {
+	_xlog_ring *ring;
+	_xlog_record *r;
+	unsigned long tail;
+	va_list ap;
+
+	if (!__atomic_load_n(&_xlog.running, __ATOMIC_ACQUIRE)) {
+		va_start(ap, format);
+		vfprintf(stderr, format, ap);
+		va_end(ap);
+		return;
+	}
+	if (level < _xlog.level) return;
+	if ((ring = _xlog_local) == NULL || _xlog_local_generation != _xlog.generation) {
+		/* first record from this thread since xlog_init() */
+		if ((ring = _xlog_local = _xlog_ring_init()) == NULL) return;
+		_xlog_local_generation = _xlog.generation;
+	}
+
+	tail = ring->tail;
+	while (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) > ring->mask) {
+		if (_xlog.policy == XLOG_DROP || !__atomic_load_n(&_xlog.running, __ATOMIC_ACQUIRE)) {
+			__atomic_fetch_add(&_xlog.dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+		sched_yield();
+	}
+
+	r = &ring->records[tail & ring->mask];
+	r->format = format;
+	r->level = level > XLOG_FATAL ? XLOG_FATAL : level;
+	clock_gettime(CLOCK_REALTIME, &r->ts);
+	va_start(ap, format);
+	_xlog_capture(r, format, ap);
+	va_end(ap);
+
+	__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Waits until everything logged before the call has been written
+ */
+void xlog_flush(void) {
+	unsigned long ticket;
+
+	if (!__atomic_load_n(&_xlog.running, __ATOMIC_ACQUIRE)) return;
+	pthread_mutex_lock(&_xlog.lock);
+	ticket = ++_xlog.flush_requested;
+	while ((long)(_xlog.flush_done - ticket) < 0 && _xlog.running)
+		pthread_cond_wait(&_xlog.flushed, &_xlog.lock);
+	pthread_mutex_unlock(&_xlog.lock);
+}
+
+/**
+ * Flushes and stops the writer thread. Rings of threads that have exited
+ * are freed; a thread still running may be writing into its own, so it
+ * frees it itself when it exits or next logs after xlog_init(). Records
+ * logged while the writer stops can be lost.
+ */
+void xlog_shutdown(void) {
+	_xlog_ring *ring, *next;
+
+	if (!_xlog.running) return;
+	xlog_flush();
+
+	pthread_mutex_lock(&_xlog.lock);
+	__atomic_store_n(&_xlog.running, 0, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&_xlog.flushed);
+	pthread_mutex_unlock(&_xlog.lock);
+	pthread_join(_xlog.writer, NULL);
+
+	pthread_mutex_lock(&_xlog.lock);
+	for (ring = _xlog.rings; ring != NULL; ring = next) {
+		next = ring->next;
+		if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE)) _xlog_ring_free(ring);
+		else ring->orphaned = 1;
+	}
+	_xlog.rings = NULL;
+	pthread_mutex_unlock(&_xlog.lock);
+}
+
+/**
+ * Returns how many records XLOG_DROP has discarded
+ */
+unsigned long long xlog_dropped(void) {
+	return __atomic_load_n(&_xlog.dropped, __ATOMIC_RELAXED);
 }
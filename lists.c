@@ -9,8 +9,17 @@
 #include "xstdlib.h"
  
 list *list_init(void) {
+	return list_init_a(NULL);
+}
+
+/**
+ * Creates a list whose elements, and the list itself, come from allocator a.
+ * DYNAMIC data still belongs to the caller's malloc() and is free()d.
+ */
+list *list_init_a(const xallocator *a) {
 	list *new_list = NULL;
-	if ((new_list = (list *)malloc(sizeof(list))) == NULL) return NULL;
+	if ((new_list = (list *)xalloc(a, sizeof(list))) == NULL) return NULL;
+	new_list->allocator = a;
 	new_list->size = 0;
 	new_list->head = NULL;
 	new_list->tail = NULL;
@@ -21,7 +30,7 @@ list *list_init(void) {
 
 list_element *list_element_init(list *l, void *data, unsigned short type, unsigned short memory_type) {
 	list_element *el = NULL;
-	if ((el = (list_element *)malloc(sizeof(list_element))) == NULL) return NULL;
+	if ((el = (list_element *)xalloc(l->allocator, sizeof(list_element))) == NULL) return NULL;
 	
 	el->data = data;
 	el->type = type;
@@ -113,46 +122,29 @@ void list_remove_element(list *l, list_element *e) {
 	e->list = NULL;
 	e->type = 0;
 	e->memory_type = 0;
-	free(e); e = NULL;
+	xalloc_free(l->allocator, e); e = NULL;
 	l->size--;
 }
 
 void list_destroy(list *l) {
 	list_clear(l);
-	if (l != NULL) { free(l); l = NULL; }
+	if (l != NULL) { xalloc_free(l->allocator, l); l = NULL; }
 }
 
 void list_print(list *l) {
-	list_element *e;
-	printf("[ ");
-	while ((e = list_current(l)) != NULL) {
-		if (e->print == NULL) {
-			switch (e->type) {
-				case CHAR: printf("'%c',", *((char *)e->data)); break;
-				case STRING: printf("\"%s\",", (char *)e->data); break; // this would be a string of sorts
-				case SHORT: printf("%d,", *((short *)e->data)); break;
-				case USHORT: printf("%u,", *((unsigned short *)e->data)); break;
-				case INT: printf("%d,", *((int *)e->data)); break;
-				case UINT: printf("%u,", *((unsigned int *)e->data)); break;
-				case LONG: printf("%ld,", *((long *)e->data)); break;
-				case ULONG: printf("%lu,", *((unsigned long *)e->data)); break;
-				case LONGLONG: printf("%lld,", *((long long *)e->data)); break;
-				case ULONGLONG: printf("%llu,", *((unsigned long long *)e->data)); break;
-				case FLOAT: printf("%.8f,", *((float *)e->data)); break;
-				case DOUBLE: printf("%.16f,", *((double *)e->data)); break;
-				case LONGDOUBLE: printf("%.16Lf,", *((long double *)e->data)); break;
-			}
-		} else {
-			e->print(e);
-		}
-	}
-	printf(" ]\n");
+	xwriter w;
+	fflush(stdout);
+	xwriter_fd(&w, STDOUT_FILENO, 0);
+	list_serialize(&w, l, XSERIAL_PRINT_CALLBACKS);
+	xwriter_putc(&w, '\n');
+	xwriter_close(&w);
 }
 
 void list_free_element_data(list_element *e) {
 	if (e->destroy != NULL) {
 		e->destroy(e->data);
 	} else {
+		/* DYNAMIC data was malloc()ed by the caller, not taken from the list's allocator */
 		if (e->memory_type == DYNAMIC) free(e->data);
 		e->data = NULL;
 	}
@@ -172,12 +164,9 @@ void list_random_fill(list *l, unsigned int qty) {
 	srand(time(NULL));
 	while (qty-- > 0) {
 		long double *n;
-		if ((n = (long double *)malloc(sizeof(long double))) == NULL) {
-			fprintf(stderr, "Ran out of memory in list_random_fill...\n");
-			exit(EXIT_FAILURE);
-		}
+		if ((n = (long double *)malloc(sizeof(long double))) == NULL) return;
 		*n = random(0, 100000);
-		list_push_back(l, n, LONGDOUBLE, DYNAMIC);
+		if (list_push_back(l, n, LONGDOUBLE, DYNAMIC) == NULL) { free(n); return; }
 	}
 }
 
@@ -7,89 +7,241 @@
  *********************************************************************/
 
 #include "xstdlib.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * The base conversion kernels below work on 8 characters at a time inside
+ * a 64-bit register (SWAR). Loaded bytes are put in big-endian order first
+ * so the leftmost character is always the most significant digit.
+ */
+#define _NUM_ONES  0x0101010101010101ULL
+#define _NUM_HIGHS 0x8080808080808080ULL
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	#define _NUM_BE(x) (x)
+#else
+	#define _NUM_BE(x) __builtin_bswap64(x)
+#endif
+/* high bit of every byte in [lo, hi], bytes must be below 0x80 */
+#define _NUM_BETWEEN(x, lo, hi) \
+	(((x) + (0x80ULL - (lo)) * _NUM_ONES) & ~((x) + (0x7FULL - (hi)) * _NUM_ONES) & _NUM_HIGHS)
+
+static const char _hex_digits[] = "0123456789ABCDEF";
+
+static int _rational_approx(rational *r, double x, long long max_den, double tolerance);
+
+/* 8 binary characters to a byte, -1 if one of them is not '0' or '1' */
+static inline int _bin8_get(const char *s) {
+	unsigned long long x;
+	memcpy(&x, s, 8);
+	if ((x & 0xFEFEFEFEFEFEFEFEULL) != 0x3030303030303030ULL) return -1;
+	return (int)(((_NUM_BE(x) & _NUM_ONES) * 0x0102040810204080ULL) >> 56);
+}
+
+static inline void _bin8_put(unsigned int b, char *s) {
+	unsigned long long x = (b * _NUM_ONES) & 0x8040201008040201ULL;
+	x = ((x + 0x7F7F7F7F7F7F7F7FULL) >> 7) & _NUM_ONES;
+	x = _NUM_BE(x) | 0x3030303030303030ULL;
+	memcpy(s, &x, 8);
+}
+
+/* 8 hex characters to 32 bits, -1 if one of them is not a hex digit */
+static inline long long _hex8_get(const char *s) {
+	unsigned long long x;
+	memcpy(&x, s, 8);
+	if ((x & _NUM_HIGHS) != 0) return -1;
+	if ((_NUM_BETWEEN(x, '0', '9') | _NUM_BETWEEN(x, 'A', 'F') | _NUM_BETWEEN(x, 'a', 'f')) != _NUM_HIGHS) return -1;
+	x = (x & 0x0F0F0F0F0F0F0F0FULL) + ((x >> 6) & _NUM_ONES) * 9;
+	x = _NUM_BE(x);
+	x = ((x >> 4) | x) & 0x00FF00FF00FF00FFULL;
+	x = ((x >> 8) | x) & 0x0000FFFF0000FFFFULL;
+	return (long long)(((x >> 16) | x) & 0xFFFFFFFFULL);
+}
+
+static inline void _hex8_put(unsigned int n, char *s) {
+	unsigned long long x = n;
+	x = ((x & 0xFFFF0000ULL) << 16) | (x & 0x0000FFFFULL);
+	x = ((x & 0x0000FF000000FF00ULL) << 8) | (x & 0x000000FF000000FFULL);
+	x = ((x & 0x00F000F000F000F0ULL) << 4) | (x & 0x000F000F000F000FULL);
+	x += 0x3030303030303030ULL + (((x + 0x0606060606060606ULL) >> 4) & _NUM_ONES) * 7;
+	x = _NUM_BE(x);
+	memcpy(s, &x, 8);
+}
+
+static inline int _hex_value(unsigned char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	c |= 0x20;
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+/* writes the low width bits of v, most significant first */
+static inline void _bin_put(unsigned long long v, unsigned int width, char *out) {
+	char *p = out + width;
+	while (p - out >= 8) { p -= 8; _bin8_put(v & 0xFF, p); v >>= 8; }
+	while (p > out) { *--p = '0' + (v & 1); v >>= 1; }
+}
+
+static inline void _hex_put(unsigned long long v, unsigned int width, char *out) {
+	char *p = out + width;
+	while (p - out >= 8) { p -= 8; _hex8_put(v & 0xFFFFFFFF, p); v >>= 32; }
+	while (p > out) { *--p = _hex_digits[v & 0xF]; v >>= 4; }
+}
+
+/* parses exactly width characters, returns -1 if one of them is invalid */
+static inline int _bin_get(const char *s, unsigned int width, unsigned long long *v) {
+	unsigned long long dec = 0;
+	unsigned int i = 0;
+	int b;
+	for ( ; i + 8 <= width; i += 8) {
+		if ((b = _bin8_get(s + i)) < 0) return -1;
+		dec = (dec << 8) | b;
+	}
+	for ( ; i < width; i++) {
+		if (s[i] != '0' && s[i] != '1') return -1;
+		dec = (dec << 1) | (s[i] - '0');
+	}
+	*v = dec;
+	return 0;
+}
+
+static inline int _hex_get(const char *s, unsigned int width, unsigned long long *v) {
+	unsigned long long dec = 0;
+	unsigned int i = 0;
+	long long h;
+	int n;
+	for ( ; i + 8 <= width; i += 8) {
+		if ((h = _hex8_get(s + i)) < 0) return -1;
+		dec = (dec << 32) | h;
+	}
+	for ( ; i < width; i++) {
+		if ((n = _hex_value(s[i])) < 0) return -1;
+		dec = (dec << 4) | n;
+	}
+	*v = dec;
+	return 0;
+}
 
 /**
  * Converts a binary string to a base 10 decimal
  */
 int bin2dec(const char *bin) {
-	int i, str_size = strlen(bin);
-	int dec = 0;
+	return (int)bin2dec_u64(bin);
+}
+
+/**
+ * Converts a binary string to an unsigned 64-bit integer, stopping at the
+ * first character that is not '0' or '1'
+ */
+unsigned long long bin2dec_u64(const char *bin) {
+	size_t len = strlen(bin), i = 0;
+	unsigned long long dec = 0;
+	int b;
 	
-	for (i = 0; i < str_size; i++) {
-		/* if the character is an "off" bit skip it in the loop */
-		if (bin[i] == '0') continue;
-		dec += pow(2, str_size - (i + 1));
+	for ( ; i + 8 <= len; i += 8) {
+		if ((b = _bin8_get(bin + i)) < 0) break;
+		dec = (dec << 8) | b;
 	}
+	for ( ; i < len && (bin[i] == '0' || bin[i] == '1'); i++) dec = (dec << 1) | (bin[i] - '0');
 	
 	return dec;
 }
 
 /**
- * Converts a character that "is" a number to its real data type
- * an integer
+ * Parses count fixed width binary fields packed back to back in "in"
+ * @return the number of fields parsed before the first invalid one
  */
-int ctoi(unsigned char c) {
-	switch (c) {
-		case 48: return 0;
-		case 49: return 1;
-		case 50: return 2;
-		case 51: return 3;
-		case 52: return 4;
-		case 53: return 5;
-		case 54: return 6;
-		case 55: return 7;
-		case 56: return 8;
-		case 57: return 9;
-	}
-	
-	return -1;
+size_t bin2dec_array(const char *in, size_t count, unsigned int width, unsigned long long *out) {
+	size_t i;
+	if (width == 0 || width > 64) return 0;
+	for (i = 0; i < count; i++, in += width)
+		if (_bin_get(in, width, &out[i]) == -1) break;
+	return i;
 }
 
 char * dec2bin(int dec, char * buffer) {
-	int i, j, bin_position = 0;
-	int powers[BIT_SIZE];
-
-	for (i = 0; i < BIT_SIZE; i++) { powers[i] = (int)pow(2, i); if ((int)pow(2, i + 1) > dec) break; }
-	
-	for (j = i; j >= 0; j--) {
-		if (powers[j] <= dec) {
-			buffer[bin_position] = '1';
-			dec -= powers[j];
-		} else {
-			buffer[bin_position] = '0';
-		}
-
-		bin_position++;
-	}
+	return dec2bin_u64((unsigned int)dec, buffer);
+}
 
+/**
+ * Writes the binary digits of dec, without leading zeros, to buffer
+ * (at most 65 bytes with the terminator)
+ */
+char *dec2bin_u64(unsigned long long dec, char *buffer) {
+	unsigned int bits = dec != 0 ? 64 - __builtin_clzll(dec) : 1;
+	_bin_put(dec, bits, buffer);
+	buffer[bits] = '\0';
 	return buffer;
 }
 
+/**
+ * Writes the low width bits of every integer as width '0'/'1' characters,
+ * back to back and without terminators
+ * @return the number of bytes written
+ */
+size_t dec2bin_array(const unsigned long long *in, size_t count, unsigned int width, char *out) {
+	size_t i;
+	if (width == 0 || width > 64) return 0;
+	for (i = 0; i < count; i++, out += width) _bin_put(in[i], width, out);
+	return count * width;
+}
+
 void dec2frac(float decimal, float *le_fraction) {
-	float mixed        = floor(decimal);
-	if (decimal < 0) mixed = ceil(decimal);
-	if (mixed == -0) mixed = 0;
+	rational q;
+	long long mixed, numerator;
+	
+	if (!_rational_approx(&q, decimal, 1000000, fabs(decimal) * FLT_EPSILON)) {
+		le_fraction[0] = le_fraction[1] = 0;
+		le_fraction[2] = 1;
+		return;
+	}
+	
+	mixed     = q.num / q.den;
+	numerator = q.num % q.den;
 	
-	float denominator  = 100.0;
-	float numerator    = xround(decimal - mixed, 2) * denominator;
-
-	if (mixed <= -1) numerator *= -1;
 	if (numerator == 0) {
-		numerator = mixed;
-		mixed = 0;
-		denominator = 1;
+		le_fraction[0] = 0;
+		le_fraction[1] = mixed;
+		le_fraction[2] = 1;
+		return;
 	}
 	
+	/* the sign lives on the whole part unless there is none */
+	if (mixed != 0 && numerator < 0) numerator *= -1;
+	
 	le_fraction[0]     = mixed;
 	le_fraction[1]     = numerator;
-	le_fraction[2]     = denominator;
+	le_fraction[2]     = q.den;
 }
 
 char *dec2hex(int dec, char *buffer) {
-	sprintf(buffer, "%X", dec);
+	return dec2hex_u64((unsigned int)dec, buffer);
+}
+
+/**
+ * Writes the uppercase hex digits of dec, without leading zeros, to buffer
+ * (at most 17 bytes with the terminator)
+ */
+char *dec2hex_u64(unsigned long long dec, char *buffer) {
+	unsigned int digits = dec != 0 ? (67 - __builtin_clzll(dec)) / 4 : 1;
+	_hex_put(dec, digits, buffer);
+	buffer[digits] = '\0';
 	return buffer;
 }
 
+/**
+ * Writes every integer as width uppercase hex digits (at most 16), back to
+ * back and without terminators
+ * @return the number of bytes written
+ */
+size_t dec2hex_array(const unsigned long long *in, size_t count, unsigned int width, char *out) {
+	size_t i;
+	if (width == 0 || width > 16) return 0;
+	for (i = 0; i < count; i++, out += width) _hex_put(in[i], width, out);
+	return count * width;
+}
+
 /**
  * Returns the factorial of parameter n
  */
@@ -99,55 +251,360 @@ int fact(int n) {
 	return fac;
 }
 
+/**
+ * Greatest common divisor by Stein's binary algorithm
+ */
+unsigned long long gcd(unsigned long long a, unsigned long long b) {
+	unsigned long long t;
+	int shift;
+	
+	if (a == 0) return b;
+	if (b == 0) return a;
+	
+	shift = __builtin_ctzll(a | b);
+	a >>= __builtin_ctzll(a);
+	do {
+		b >>= __builtin_ctzll(b);
+		if (a > b) { t = b; b = a; a = t; }
+		b -= a;
+	} while (b != 0);
+	
+	return a << shift;
+}
+
 int hex2dec(char *hex) {
-	strtoupper(hex);
+	return (int)hex2dec_u64(hex);
+}
+
+/**
+ * Converts a hex string, with or without a 0x prefix, to an unsigned 64-bit
+ * integer, stopping at the first character that is not a hex digit
+ */
+unsigned long long hex2dec_u64(const char *hex) {
+	size_t len, i = 0;
+	unsigned long long dec = 0;
+	long long h;
+	int n;
+	
+	if (hex[0] == '0' && (hex[1] == 'x' || hex[1] == 'X')) hex += 2;
+	len = strlen(hex);
+	
+	for ( ; i + 8 <= len; i += 8) {
+		if ((h = _hex8_get(hex + i)) < 0) break;
+		dec = (dec << 32) | h;
+	}
+	for ( ; i < len && (n = _hex_value(hex[i])) >= 0; i++) dec = (dec << 4) | n;
+	
+	return dec;
+}
+
+/**
+ * Parses count fixed width hex fields packed back to back in "in"
+ * @return the number of fields parsed before the first invalid one
+ */
+size_t hex2dec_array(const char *in, size_t count, unsigned int width, unsigned long long *out) {
+	size_t i;
+	if (width == 0 || width > 16) return 0;
+	for (i = 0; i < count; i++, in += width)
+		if (_hex_get(in, width, &out[i]) == -1) break;
+	return i;
+}
+
+/**
+ * Initializes r to num/den in lowest terms
+ * @return 1 on success, 0 if den is 0 or the result does not fit
+ */
+int rational_init(rational *r, long long num, long long den) {
+	unsigned long long un, ud, g;
+	int negative;
+	
+	if (den == 0) return 0;
+	
+	negative = (num < 0) != (den < 0);
+	un = num < 0 ? -(unsigned long long)num : (unsigned long long)num;
+	ud = den < 0 ? -(unsigned long long)den : (unsigned long long)den;
+	
+	g = gcd(un, ud);
+	un /= g;
+	ud /= g;
+	
+	if (ud > LLONG_MAX || un > (unsigned long long)LLONG_MAX + negative) return 0;
 	
-	int hex_size = (int)strlen(hex);
+	r->num = negative ? (long long)(0 - un) : (long long)un;
+	r->den = (long long)ud;
+	return 1;
+}
 
-	int i, power = 1, sum = 0, eval, base, column;
+int rational_reduce(rational *r) {
+	return rational_init(r, r->num, r->den);
+}
 
-	for (i = hex_size - 1, column = 1; i >= 0; i--, column++) {
-		eval = 0;
+/**
+ * Reduces every rational in place
+ * @return the number of entries that could be reduced
+ */
+size_t rational_reduce_array(rational *r, size_t count) {
+	size_t i, reduced = 0;
+	for (i = 0; i < count; i++) reduced += rational_init(&r[i], r[i].num, r[i].den);
+	return reduced;
+}
 
-		if (column == 1) { base = 1; } else if (column == 2) { base = 16; } else { power = column - 1; }
-		
-		switch (hex[i]) {
-			case 'A': eval = (int)pow(base, power) * 10; break;
-			case 'B': eval = (int)pow(base, power) * 11; break;
-			case 'C': eval = (int)pow(base, power) * 12; break;
-			case 'D': eval = (int)pow(base, power) * 13; break;
-			case 'E': eval = (int)pow(base, power) * 14; break;
-			case 'F': eval = (int)pow(base, power) * 15; break;
-			default:  eval = (int)pow(base, power) * ctoi(hex[i]); break;
-		}
+/**
+ * r = a + b, dividing out gcd(a.den, b.den) first to delay overflow
+ * @return 1 on success, 0 on overflow
+ */
+int rational_add(rational *r, const rational *a, const rational *b) {
+	long long g = (long long)gcd(a->den, b->den);
+	long long x, y, num, den;
+	
+	if (__builtin_mul_overflow(a->num, b->den / g, &x)) return 0;
+	if (__builtin_mul_overflow(b->num, a->den / g, &y)) return 0;
+	if (__builtin_add_overflow(x, y, &num)) return 0;
+	if (__builtin_mul_overflow(a->den / g, b->den, &den)) return 0;
+	
+	return rational_init(r, num, den);
+}
 
-		sum += eval;
-	}
+int rational_sub(rational *r, const rational *a, const rational *b) {
+	rational negated;
+	if (b->num == LLONG_MIN) return 0;
+	negated.num = -b->num;
+	negated.den = b->den;
+	return rational_add(r, a, &negated);
+}
+
+/**
+ * r = a * b, cross-reducing first so the result needs no further reduction
+ * @return 1 on success, 0 on overflow
+ */
+int rational_mul(rational *r, const rational *a, const rational *b) {
+	long long g1 = (long long)gcd(a->num < 0 ? -(unsigned long long)a->num : a->num, b->den);
+	long long g2 = (long long)gcd(b->num < 0 ? -(unsigned long long)b->num : b->num, a->den);
+	long long num, den;
+	
+	if (g1 == 0) g1 = 1;
+	if (g2 == 0) g2 = 1;
+	if (__builtin_mul_overflow(a->num / g1, b->num / g2, &num)) return 0;
+	if (__builtin_mul_overflow(a->den / g2, b->den / g1, &den)) return 0;
 	
-	return sum;
+	return rational_init(r, num, den);
 }
 
-void reduce_frac(float *le_fraction, float *reduce) {
-	int i;
-	int gcd = 1;
-	int increment = ((int)le_fraction[1] % 2 == 0) ? 1 : 2;
+/**
+ * r = a / b
+ * @return 1 on success, 0 on overflow or division by zero
+ */
+int rational_div(rational *r, const rational *a, const rational *b) {
+	rational inverse;
+	if (b->num == 0 || b->num == LLONG_MIN) return 0;
+	inverse.num = b->num < 0 ? -b->den : b->den;
+	inverse.den = b->num < 0 ? -b->num : b->num;
+	return rational_mul(r, a, &inverse);
+}
 
-	int num = (int)le_fraction[1];
+#ifndef __SIZEOF_INT128__
+/* compares an/ad with bn/bd (positive denominators) by their continued fractions */
+static int _rational_cmp(long long an, long long ad, long long bn, long long bd) {
+	long long qa = an / ad, ra = an % ad;
+	long long qb = bn / bd, rb = bn % bd;
+	
+	if (ra < 0) { qa--; ra += ad; }
+	if (rb < 0) { qb--; rb += bd; }
+	if (qa != qb) return qa < qb ? -1 : 1;
+	if (ra == 0 || rb == 0) return (ra != 0) - (rb != 0);
 	
-	if (le_fraction[1] < 0) num *= -1;
+	return _rational_cmp(bd, rb, ad, ra);
+}
+#endif
+
+/**
+ * Exact comparison
+ * @return -1, 0 or 1 as a is less than, equal to or greater than b
+ */
+int rational_cmp(const rational *a, const rational *b) {
+#ifdef __SIZEOF_INT128__
+	__int128 x = (__int128)a->num * b->den;
+	__int128 y = (__int128)b->num * a->den;
+	return (x > y) - (x < y);
+#else
+	return _rational_cmp(a->num, a->den, b->num, b->den);
+#endif
+}
+
+/* best approximation with a denominator up to max_den, or the first
+ * convergent within tolerance of x */
+static int _rational_approx(rational *r, double x, long long max_den, double tolerance) {
+	long long p0 = 0, q0 = 1, p1 = 1, q1 = 0, p2, q2, a, k;
+	double f, frac;
+	int i, negative = x < 0;
 	
-	for (i = 1; i <= num; i += increment) {
-		if (num % i == 0 && (int)le_fraction[2] % i == 0) {
-			if (i > gcd) gcd = i;
+	if (!isfinite(x) || fabs(x) >= 9.2e18) return 0;
+	if (max_den <= 0) max_den = RATIONAL_MAX_DEN;
+	
+	f = fabs(x);
+	for (i = 0; i < 64; i++) {
+		a = (long long)floor(f);
+		if (__builtin_mul_overflow(a, p1, &p2) || __builtin_add_overflow(p2, p0, &p2)) break;
+		if (__builtin_mul_overflow(a, q1, &q2) || __builtin_add_overflow(q2, q0, &q2) || q2 > max_den) {
+			/* the best semiconvergent may still beat the last convergent */
+			if (q1 == 0) break;
+			k = (max_den - q0) / q1;
+			if (k > 0 && fabs(fabs(x) - (double)(p0 + k * p1) / (q0 + k * q1)) < fabs(fabs(x) - (double)p1 / q1)) {
+				p1 = p0 + k * p1;
+				q1 = q0 + k * q1;
+			}
+			break;
 		}
+		p0 = p1; q0 = q1;
+		p1 = p2; q1 = q2;
+		
+		if (fabs(fabs(x) - (double)p1 / q1) <= tolerance) break;
+		if ((frac = f - a) <= 0) break;
+		f = 1.0 / frac;
 	}
+	if (q1 == 0) return 0;
+	
+	r->num = negative ? -p1 : p1;
+	r->den = q1;
+	return 1;
+}
+
+/**
+ * Finds the closest rational to x with a denominator no larger than
+ * max_den (RATIONAL_MAX_DEN when 0), using continued fractions
+ * @return 1 on success, 0 if x is not finite or out of range
+ */
+int rational_from_double(rational *r, double x, long long max_den) {
+	return _rational_approx(r, x, max_den, 0);
+}
+
+double rational_to_double(const rational *r) {
+	return (double)r->num / (double)r->den;
+}
+
+void reduce_frac(float *le_fraction, float *reduce) {
+	long long num = (long long)le_fraction[1];
+	long long den = (long long)le_fraction[2];
+	unsigned long long g = gcd(num < 0 ? -num : num, den < 0 ? -den : den);
+	
+	if (g == 0) g = 1;
 	
 	reduce[0] = le_fraction[0];
-	reduce[1] = le_fraction[1] / (float)gcd;
-	reduce[2] = le_fraction[2] / (float)gcd;
+	reduce[1] = le_fraction[1] / (float)g;
+	reduce[2] = le_fraction[2] / (float)g;
+}
+
+/* every power of ten that is exact as a double */
+static const double _pow10[] = {
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static inline double _xround_scale(int precision) {
+	if (precision >= 0 && precision <= 22) return _pow10[precision];
+	if (precision < 0 && precision >= -22) return 1.0 / _pow10[-precision];
+	return pow(10, precision);
+}
+
+/*
+ * The rounding kernel. Adding and subtracting 2^52 rounds a double below
+ * 2^52 to the nearest integer (ties to even) using plain adds, so the same
+ * steps run on SSE2 lanes. The scalar entry points go through the vector
+ * kernel too, which keeps them bit-identical to the array forms.
+ */
+#define _XROUND_MAGIC 4503599627370496.0
+
+#ifdef __SSE2__
+static inline __m128d _xround_pd(__m128d x, __m128d scale, unsigned short mode) {
+	const __m128d magic = _mm_set1_pd(_XROUND_MAGIC);
+	const __m128d sign  = _mm_set1_pd(-0.0);
+	const __m128d one   = _mm_set1_pd(1.0);
+	__m128d y, a, r, integral;
+	
+	y = _mm_mul_pd(x, scale);
+	if (mode == XROUND_HALF_UP) y = _mm_add_pd(y, _mm_set1_pd(0.5));
+	a = _mm_andnot_pd(sign, y);
+	integral = _mm_cmpge_pd(a, magic);
+	r = _mm_sub_pd(_mm_add_pd(a, magic), magic);
+	
+	if (mode == XROUND_HALF_UP) {
+		/* floor */
+		r = _mm_or_pd(r, _mm_and_pd(y, sign));
+		r = _mm_sub_pd(r, _mm_and_pd(_mm_cmpgt_pd(r, y), one));
+	} else {
+		if (mode == XROUND_TRUNC) r = _mm_sub_pd(r, _mm_and_pd(_mm_cmpgt_pd(r, a), one));
+		r = _mm_or_pd(r, _mm_and_pd(y, sign));
+	}
+	
+	r = _mm_or_pd(_mm_and_pd(integral, y), _mm_andnot_pd(integral, r));
+	return _mm_div_pd(r, scale);
 }
+#else
+static inline double _xround_sd(double x, double scale, unsigned short mode) {
+	double y = x * scale, a, r;
+	
+	if (mode == XROUND_HALF_UP) y += 0.5;
+	a = fabs(y);
+	if (!(a < _XROUND_MAGIC)) return y / scale;
+	r = (a + _XROUND_MAGIC) - _XROUND_MAGIC;
+	
+	if (mode == XROUND_HALF_UP) {
+		r = copysign(r, y);
+		if (r > y) r -= 1.0;
+	} else {
+		if (mode == XROUND_TRUNC && r > a) r -= 1.0;
+		r = copysign(r, y);
+	}
+	return r / scale;
+}
+#endif
 
 float xround(const float n, int precision) {
-	return floor(n * pow(10, precision) + 0.5) / pow(10, precision);
+	return (float)xround_d(n, precision, XROUND_HALF_UP);
 }
 
+/**
+ * Rounds n to precision decimal places (negative for tens, hundreds...)
+ * @param mode XROUND_HALF_UP, XROUND_HALF_EVEN or XROUND_TRUNC
+ */
+double xround_d(const double n, int precision, unsigned short mode) {
+#ifdef __SSE2__
+	return _mm_cvtsd_f64(_xround_pd(_mm_set_sd(n), _mm_set1_pd(_xround_scale(precision)), mode));
+#else
+	return _xround_sd(n, _xround_scale(precision), mode);
+#endif
+}
+
+/**
+ * Rounds every float in place; each result is identical to xround_d()
+ * on the same value narrowed back to float
+ */
+void xround_array(float *a, size_t count, int precision, unsigned short mode) {
+	size_t i = 0;
+	double scale = _xround_scale(precision);
+#ifdef __SSE2__
+	__m128d s = _mm_set1_pd(scale);
+	__m128 v;
+	for ( ; i + 4 <= count; i += 4) {
+		v = _mm_loadu_ps(a + i);
+		v = _mm_movelh_ps(_mm_cvtpd_ps(_xround_pd(_mm_cvtps_pd(v), s, mode)),
+		                  _mm_cvtpd_ps(_xround_pd(_mm_cvtps_pd(_mm_movehl_ps(v, v)), s, mode)));
+		_mm_storeu_ps(a + i, v);
+	}
+	for ( ; i < count; i++) a[i] = (float)_mm_cvtsd_f64(_xround_pd(_mm_set_sd(a[i]), s, mode));
+#else
+	for ( ; i < count; i++) a[i] = (float)_xround_sd(a[i], scale, mode);
+#endif
+}
+
+void xround_array_d(double *a, size_t count, int precision, unsigned short mode) {
+	size_t i = 0;
+	double scale = _xround_scale(precision);
+#ifdef __SSE2__
+	__m128d s = _mm_set1_pd(scale);
+	for ( ; i + 2 <= count; i += 2) _mm_storeu_pd(a + i, _xround_pd(_mm_loadu_pd(a + i), s, mode));
+	for ( ; i < count; i++) a[i] = _mm_cvtsd_f64(_xround_pd(_mm_set_sd(a[i]), s, mode));
+#else
+	for ( ; i < count; i++) a[i] = _xround_sd(a[i], scale, mode);
+#endif
+}
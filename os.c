@@ -8,16 +8,271 @@
 
 #include "xstdlib.h"
 
-char * shell_exec(const char *command, char *out) {
-	FILE *in;
-	if ((in = popen(command, "r")) == NULL) return NULL;
+extern char **environ;
+
+typedef struct __shell_proc__ {
+	pid_t pid;
+	unsigned char group;   /* the command leads its own process group */
+	int fds[2];        /* read ends for stdout and stderr, -1 once closed */
+	long long deadline;
+	unsigned char killed;
+	shell_result *result;
+} _shell_proc;
+
+static long long _shell_now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int _shell_pipe(int p[2]) {
+	if (pipe(p) == -1) return -1;
+	/* keep the pipes of one command out of every other command we spawn */
+	fcntl(p[0], F_SETFD, FD_CLOEXEC);
+	fcntl(p[1], F_SETFD, FD_CLOEXEC);
+	return 0;
+}
+
+static int _shell_spawn(const char *command, const shell_opts *opts, _shell_proc *p) {
+	int out[2], err[2] = { -1, -1 };
+	char *argv[] = { "sh", "-c", (char *)command, NULL };
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	int rc;
+
+	if (_shell_pipe(out) == -1) return -1;
+	if (opts->stderr_mode == SHELL_STDERR_CAPTURE && _shell_pipe(err) == -1) {
+		close(out[0]); close(out[1]);
+		return -1;
+	}
+
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+	if (opts->stderr_mode == SHELL_STDERR_CAPTURE)
+		posix_spawn_file_actions_adddup2(&actions, err[1], STDERR_FILENO);
+	else if (opts->stderr_mode == SHELL_STDERR_MERGE)
+		posix_spawn_file_actions_adddup2(&actions, out[1], STDERR_FILENO);
+
+	/*
+	 * A command we may kill (timed, or stopped by on_output) gets its own
+	 * process group so the whole tree goes. Others stay in ours so they
+	 * can read the terminal and see Ctrl-C.
+	 */
+	p->group = opts->timeout_ms > 0 || opts->on_output != NULL;
+	posix_spawnattr_init(&attr);
+	if (p->group) {
+		posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+		posix_spawnattr_setpgroup(&attr, 0);
+	}
+
+	rc = posix_spawn(&p->pid, "/bin/sh", &actions, &attr, argv, environ);
+
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attr);
+	close(out[1]);
+	if (err[1] != -1) close(err[1]);
+
+	if (rc != 0) {
+		close(out[0]);
+		if (err[0] != -1) close(err[0]);
+		return -1;
+	}
+
+	p->fds[0] = out[0];
+	p->fds[1] = err[0];
+	p->deadline = opts->timeout_ms > 0 ? _shell_now_ms() + opts->timeout_ms : 0;
+	p->killed = 0;
+	return 0;
+}
+
+static void _shell_kill(_shell_proc *p) {
+	kill(p->group ? -p->pid : p->pid, SIGKILL);
+	p->killed = 1;
+}
+
+static int _shell_append(char **buf, size_t *len, size_t *cap, const char *data, size_t n) {
+	if (*len + n + 1 > *cap) {
+		size_t new_cap = *cap ? *cap : 4 * KB;
+		char *grown;
+		while (*len + n + 1 > new_cap) new_cap *= 2;
+		if ((grown = (char *)realloc(*buf, new_cap)) == NULL) return -1;
+		*buf = grown;
+		*cap = new_cap;
+	}
+	memcpy(*buf + *len, data, n);
+	*len += n;
+	(*buf)[*len] = '\0';
+	return 0;
+}
+
+/* drains what is available on one stream, closing it on end of file */
+static void _shell_read(_shell_proc *p, int i, const shell_opts *opts, size_t caps[2]) {
+	char chunk[64 * KB];
+	ssize_t n;
+	shell_result *r = p->result;
+	char **buf = i == 0 ? &r->out : &r->err;
+	size_t *len = i == 0 ? &r->out_len : &r->err_len;
+	size_t keep;
+
+	if ((n = read(p->fds[i], chunk, sizeof(chunk))) == -1 && errno == EINTR) return;
+	if (n <= 0) { close(p->fds[i]); p->fds[i] = -1; return; }
+	if (p->killed) return;
+
+	if (opts->on_output != NULL) {
+		if (opts->on_output(i == 0 ? SHELL_STDOUT : SHELL_STDERR, chunk, n, opts->arg) != 0)
+			_shell_kill(p);
+		return;
+	}
 
-	char _out[LINE_MAX];
+	keep = n;
+	if (opts->max_output > 0 && *len + keep > opts->max_output) {
+		keep = opts->max_output - *len;
+		r->truncated = 1;
+	}
+	if (keep > 0 && _shell_append(buf, len, &caps[i], chunk, keep) == -1) r->truncated = 1;
+}
+
+static int _shell_reap(_shell_proc *p, int options) {
+	int status;
+	pid_t rc;
+	while ((rc = waitpid(p->pid, &status, options)) == -1 && errno == EINTR);
+	if (rc == 0) return 0;
+	if (rc == -1) p->result->status = -1;
+	else if (WIFEXITED(status)) p->result->status = WEXITSTATUS(status);
+	else if (WIFSIGNALED(status)) p->result->status = 128 + WTERMSIG(status);
+	return 1;
+}
+
+/**
+ * Runs every command with at most parallelism of them alive at once,
+ * multiplexing all of their output through a single poll() loop
+ */
+static void _shell_run_all(const char *commands[], int count, int parallelism, const shell_opts *opts, shell_result results[]) {
+	_shell_proc *procs;
+	size_t (*caps)[2];
+	struct pollfd *pfds;
+	int *owner;
+	int next = 0, active = 0;
+	int i, j, n, timeout;
+	long long now;
+
+	if (parallelism <= 0 || parallelism > count) parallelism = count;
+	for (i = 0; i < count; i++) {
+		memset(&results[i], 0, sizeof(shell_result));
+		results[i].status = -1;
+	}
+
+	procs = (_shell_proc *)calloc(parallelism, sizeof(_shell_proc));
+	caps  = calloc(parallelism, sizeof(*caps));
+	pfds  = (struct pollfd *)calloc(parallelism * 2, sizeof(struct pollfd));
+	owner = (int *)calloc(parallelism * 2, sizeof(int));
+	if (procs == NULL || caps == NULL || pfds == NULL || owner == NULL) goto done;
+	for (i = 0; i < parallelism; i++) procs[i].result = NULL;
+
+	while (next < count || active > 0) {
+		for (i = 0; i < parallelism && next < count; i++) {
+			if (procs[i].result != NULL) continue;
+			procs[i].result = &results[next];
+			caps[i][0] = caps[i][1] = 0;
+			if (_shell_spawn(commands[next], opts, &procs[i]) == -1) {
+				procs[i].result = NULL;
+			} else {
+				active++;
+			}
+			next++;
+		}
+		if (active == 0) continue;
+
+		now = _shell_now_ms();
+		timeout = -1;
+		for (i = 0, n = 0; i < parallelism; i++) {
+			if (procs[i].result == NULL) continue;
+			if (procs[i].deadline > 0 && !procs[i].killed) {
+				if (now >= procs[i].deadline) {
+					procs[i].result->timed_out = 1;
+					_shell_kill(&procs[i]);
+				} else if (timeout == -1 || procs[i].deadline - now < timeout) {
+					timeout = (int)(procs[i].deadline - now);
+				}
+			}
+			for (j = 0; j < 2; j++) {
+				if (procs[i].fds[j] == -1) continue;
+				pfds[n].fd = procs[i].fds[j];
+				pfds[n].events = POLLIN;
+				pfds[n].revents = 0;
+				owner[n++] = i * 2 + j;
+			}
+			/* both streams are closed but the command has not exited yet */
+			if (procs[i].fds[0] == -1 && procs[i].fds[1] == -1 && (timeout == -1 || timeout > 10))
+				timeout = 10;
+		}
+
+		if (n > 0 && poll(pfds, n, timeout) == -1 && errno != EINTR) break;
+		if (n == 0 && timeout > 0) poll(NULL, 0, timeout);
+
+		for (j = 0; j < n; j++)
+			if (pfds[j].revents != 0)
+				_shell_read(&procs[owner[j] / 2], owner[j] % 2, opts, caps[owner[j] / 2]);
+
+		for (i = 0; i < parallelism; i++) {
+			if (procs[i].result == NULL || procs[i].fds[0] != -1 || procs[i].fds[1] != -1) continue;
+			if (_shell_reap(&procs[i], WNOHANG)) { procs[i].result = NULL; active--; }
+		}
+	}
 
-	while (fgets(_out, LINE_MAX, in) != NULL) strcat(out, _out);
-	
-	pclose(in);
+done:
+	/* only reached early if allocation or poll() failed */
+	if (procs != NULL) {
+		for (i = 0; i < parallelism; i++) {
+			if (procs[i].result == NULL) continue;
+			for (j = 0; j < 2; j++) if (procs[i].fds[j] != -1) close(procs[i].fds[j]);
+			_shell_kill(&procs[i]);
+			_shell_reap(&procs[i], 0);
+		}
+	}
+	free(procs); free(caps); free(pfds); free(owner);
+}
+
+/**
+ * Runs a command through /bin/sh and appends its output to out
+ * @return out, NULL if the command could not be run
+ */
+char * shell_exec(const char *command, char *out) {
+	shell_result r;
+
+	if (shell_run(command, NULL, &r) == -1) return NULL;
+	if (r.out != NULL) memcpy(out + strlen(out), r.out, r.out_len + 1);
+	shell_result_free(&r);
 
 	return out;
 }
 
+/**
+ * Runs a command through /bin/sh with posix_spawn(), capturing its output
+ * @param opts NULL to capture stdout with no limits
+ * @return 0 if the command ran, -1 if it could not be started
+ */
+int shell_run(const char *command, const shell_opts *opts, shell_result *result) {
+	return shell_exec_many(&command, 1, 1, opts, result) == 0 ? 0 : -1;
+}
+
+/**
+ * Runs a batch of commands concurrently, at most parallelism at a time
+ * (0 for all at once). results[i] belongs to commands[i].
+ * @return the number of commands that could not be started
+ */
+int shell_exec_many(const char *commands[], int count, int parallelism, const shell_opts *opts, shell_result results[]) {
+	static const shell_opts defaults = { SHELL_STDERR_INHERIT, 0, 0, NULL, NULL };
+	int i, failed = 0;
+
+	_shell_run_all(commands, count, parallelism, opts != NULL ? opts : &defaults, results);
+	for (i = 0; i < count; i++) if (results[i].status == -1) failed++;
+
+	return failed;
+}
+
+void shell_result_free(shell_result *result) {
+	free(result->out); result->out = NULL;
+	free(result->err); result->err = NULL;
+	result->out_len = result->err_len = 0;
+}
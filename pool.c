@@ -0,0 +1,226 @@
+/********************************************************************
+ * Name: pool.c
+ * Author: rashaudteague
+ * License: GNU LGPL <http://www.gnu.org/licenses/>
+ * Description: A small work-stealing thread pool
+ ********************************************************************/
+
+#include "xstdlib.h"
+
+/*
+ * Every worker owns a deque. It pushes and pops its own tasks at the tail
+ * and, when that runs dry, steals from the head of the others. Tasks
+ * submitted from outside the pool are spread round-robin over the deques.
+ */
+
+static __thread xpool *_xpool_current = NULL;
+static __thread int _xpool_index = -1;
+
+static int _xpool_push(xpool_queue *q, const xpool_task *t) {
+	xpool_task *grown;
+	size_t i;
+
+	pthread_mutex_lock(&q->lock);
+	if (q->size == q->cap) {
+		if ((grown = (xpool_task *)malloc(q->cap * 2 * sizeof(xpool_task))) == NULL) {
+			pthread_mutex_unlock(&q->lock);
+			return 0;
+		}
+		for (i = 0; i < q->size; i++) grown[i] = q->tasks[(q->head + i) % q->cap];
+		free(q->tasks);
+		q->tasks = grown;
+		q->head = 0;
+		q->cap *= 2;
+	}
+	q->tasks[(q->head + q->size) % q->cap] = *t;
+	q->size++;
+	pthread_mutex_unlock(&q->lock);
+	return 1;
+}
+
+static int _xpool_pop(xpool_queue *q, xpool_task *t, int steal) {
+	int found = 0;
+	pthread_mutex_lock(&q->lock);
+	if (q->size > 0) {
+		if (steal) {
+			*t = q->tasks[q->head];
+			q->head = (q->head + 1) % q->cap;
+		} else {
+			*t = q->tasks[(q->head + q->size - 1) % q->cap];
+		}
+		q->size--;
+		found = 1;
+	}
+	pthread_mutex_unlock(&q->lock);
+	return found;
+}
+
+/**
+ * Takes a task from the calling worker's own deque, or steals one
+ */
+static int _xpool_take(xpool *p, int self, xpool_task *t) {
+	int i;
+	if (self >= 0 && _xpool_pop(&p->queues[self], t, 0)) goto found;
+	for (i = 1; i <= p->nthreads; i++)
+		if (_xpool_pop(&p->queues[(unsigned int)(self + i) % p->nthreads], t, 1)) goto found;
+	return 0;
+found:
+	__atomic_sub_fetch(&p->queued, 1, __ATOMIC_SEQ_CST);
+	return 1;
+}
+
+static void _xpool_run(xpool *p, xpool_task *t) {
+	t->fn(t->arg);
+	if (__atomic_sub_fetch(&p->pending, 1, __ATOMIC_SEQ_CST) == 0) {
+		pthread_mutex_lock(&p->lock);
+		pthread_cond_broadcast(&p->done);
+		pthread_mutex_unlock(&p->lock);
+	}
+}
+
+static void *_xpool_worker(void *arg) {
+	xpool_queue *q = (xpool_queue *)arg;
+	xpool *p = q->pool;
+	xpool_task t;
+	int stop;
+
+	_xpool_current = p;
+	_xpool_index = q - p->queues;
+	for (;;) {
+		if (_xpool_take(p, _xpool_index, &t)) { _xpool_run(p, &t); continue; }
+
+		pthread_mutex_lock(&p->lock);
+		__atomic_add_fetch(&p->sleeping, 1, __ATOMIC_SEQ_CST);
+		while (__atomic_load_n(&p->queued, __ATOMIC_SEQ_CST) == 0 && !p->stop)
+			pthread_cond_wait(&p->work, &p->lock);
+		__atomic_sub_fetch(&p->sleeping, 1, __ATOMIC_SEQ_CST);
+		stop = p->stop && __atomic_load_n(&p->queued, __ATOMIC_SEQ_CST) == 0;
+		pthread_mutex_unlock(&p->lock);
+		if (stop) break;
+	}
+	return NULL;
+}
+
+/**
+ * Stops and joins the first started workers, then frees the pool and its
+ * p->nthreads queues
+ */
+static void _xpool_free(xpool *p, int started) {
+	int i;
+
+	pthread_mutex_lock(&p->lock);
+	p->stop = 1;
+	pthread_cond_broadcast(&p->work);
+	pthread_mutex_unlock(&p->lock);
+	for (i = 0; i < started; i++) pthread_join(p->threads[i], NULL);
+
+	for (i = 0; i < p->nthreads; i++) {
+		pthread_mutex_destroy(&p->queues[i].lock);
+		free(p->queues[i].tasks);
+	}
+	pthread_mutex_destroy(&p->lock);
+	pthread_cond_destroy(&p->work);
+	pthread_cond_destroy(&p->done);
+	free(p->threads);
+	free(p->queues);
+	free(p);
+}
+
+/**
+ * Starts a pool of threads workers, one per online CPU when threads is 0.
+ * Returns NULL if the pool could not be created.
+ */
+xpool *xpool_init(int threads) {
+	xpool *p;
+	int i;
+
+	if (threads <= 0 && (threads = (int)sysconf(_SC_NPROCESSORS_ONLN)) <= 0) threads = 1;
+	if ((p = (xpool *)calloc(1, sizeof(xpool))) == NULL) return NULL;
+	if ((p->queues = (xpool_queue *)calloc(threads, sizeof(xpool_queue))) == NULL) { free(p); return NULL; }
+	if ((p->threads = (pthread_t *)malloc(threads * sizeof(pthread_t))) == NULL) { free(p->queues); free(p); return NULL; }
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->work, NULL);
+	pthread_cond_init(&p->done, NULL);
+
+	for (i = 0; i < threads; i++) {
+		xpool_queue *q = &p->queues[i];
+		q->pool = p;
+		q->cap = XPOOL_QUEUE_SIZE;
+		if ((q->tasks = (xpool_task *)malloc(q->cap * sizeof(xpool_task))) == NULL) break;
+		pthread_mutex_init(&q->lock, NULL);
+	}
+	/* workers steal from every queue, so all of them exist before any starts */
+	p->nthreads = i;
+	if (i < threads) { _xpool_free(p, 0); return NULL; }
+	for (i = 0; i < threads; i++)
+		if (pthread_create(&p->threads[i], NULL, _xpool_worker, &p->queues[i]) != 0) break;
+	if (i < threads) { _xpool_free(p, i); return NULL; }
+	return p;
+}
+
+/**
+ * Queues fn(arg) to run on the pool, returns 1 on success or 0 if out of memory
+ */
+int xpool_submit(xpool *p, void (*fn)(void *arg), void *arg) {
+	xpool_task t;
+	int q;
+
+	t.fn = fn;
+	t.arg = arg;
+	/* tasks spawned by a worker stay on its own deque until stolen */
+	q = _xpool_current == p ? _xpool_index : (int)(__atomic_fetch_add(&p->next, 1, __ATOMIC_RELAXED) % p->nthreads);
+
+	__atomic_add_fetch(&p->pending, 1, __ATOMIC_SEQ_CST);
+	if (!_xpool_push(&p->queues[q], &t)) {
+		__atomic_sub_fetch(&p->pending, 1, __ATOMIC_SEQ_CST);
+		return 0;
+	}
+	__atomic_add_fetch(&p->queued, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&p->sleeping, __ATOMIC_SEQ_CST) > 0) {
+		pthread_mutex_lock(&p->lock);
+		pthread_cond_signal(&p->work);
+		pthread_mutex_unlock(&p->lock);
+	}
+	return 1;
+}
+
+/**
+ * Runs queued tasks on the calling thread until everything submitted so far
+ * has finished. Must not be called from inside a task.
+ */
+void xpool_wait(xpool *p) {
+	int self = _xpool_current == p ? _xpool_index : -1;
+	xpool_task t;
+
+	while (__atomic_load_n(&p->pending, __ATOMIC_SEQ_CST) > 0) {
+		if (_xpool_take(p, self, &t)) { _xpool_run(p, &t); continue; }
+		pthread_mutex_lock(&p->lock);
+		while (__atomic_load_n(&p->pending, __ATOMIC_SEQ_CST) > 0 && __atomic_load_n(&p->queued, __ATOMIC_SEQ_CST) == 0)
+			pthread_cond_wait(&p->done, &p->lock);
+		pthread_mutex_unlock(&p->lock);
+	}
+}
+
+/**
+ * Runs what is still queued, then stops the workers and frees the pool
+ */
+void xpool_destroy(xpool *p) {
+	if (p == NULL) return;
+	_xpool_free(p, p->nthreads);
+}
+
+static xpool *_xpool_default = NULL;
+static pthread_once_t _xpool_default_once = PTHREAD_ONCE_INIT;
+
+static void _xpool_default_init(void) {
+	_xpool_default = xpool_init(0);
+}
+
+/**
+ * The shared pool behind the parallel vector functions, started on first
+ * use with one worker per CPU. NULL if it could not be started.
+ */
+xpool *xpool_default(void) {
+	pthread_once(&_xpool_default_once, _xpool_default_init);
+	return _xpool_default;
+}
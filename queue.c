@@ -0,0 +1,232 @@
+/********************************************************************
+ * Name: queue.c
+ * Author: rashaudteague
+ * License: GNU LGPL <http://www.gnu.org/licenses/>
+ * Description: Bounded lock-free queues for passing work between threads
+ ********************************************************************/
+
+#include "xstdlib.h"
+
+/*
+ * spsc_queue is a ring with one writer per index: the producer owns tail,
+ * the consumer owns head, and each keeps a cached copy of the other's index
+ * so it only touches the other cache line when the ring looks full or
+ * empty.
+ *
+ * mpmc_queue follows Dmitry Vyukov's bounded queue. Every cell carries a
+ * sequence number saying whose turn it is: pos for the producer that will
+ * claim position pos, pos + 1 for the consumer after it has been filled.
+ * Producers and consumers claim positions with a CAS on their own index and
+ * never wait on each other except when the queue is full or empty.
+ */
+
+static void *_xqueue_alloc(size_t size) {
+	void *p;
+	if (posix_memalign(&p, XQUEUE_CACHE_LINE, size) != 0) return NULL;
+	memset(p, 0, size);
+	return p;
+}
+
+static size_t _xqueue_capacity(size_t capacity) {
+	size_t cap = 2;
+	while (cap < capacity) cap <<= 1;
+	return cap;
+}
+
+/**
+ * Spins a little, then yields, then sleeps, for the blocking wrappers
+ */
+static void _xqueue_backoff(unsigned int *spins) {
+	struct timespec ts = { 0, 50000 };
+	if (*spins < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#endif
+	} else if (*spins < 1024) {
+		sched_yield();
+	} else {
+		nanosleep(&ts, NULL);
+		return;
+	}
+	(*spins)++;
+}
+
+/**
+ * Creates a ring holding capacity items, rounded up to a power of two
+ */
+spsc_queue *spsc_init(size_t capacity) {
+	spsc_queue *q;
+	size_t cap = _xqueue_capacity(capacity);
+	if ((q = (spsc_queue *)_xqueue_alloc(sizeof(spsc_queue))) == NULL) return NULL;
+	if ((q->items = (void **)_xqueue_alloc(cap * sizeof(void *))) == NULL) { free(q); return NULL; }
+	q->mask = cap - 1;
+	return q;
+}
+
+/**
+ * Pushes up to n items, returns how many fit. Producer thread only.
+ */
+size_t spsc_push_n(spsc_queue *q, void *const *items, size_t n) {
+	size_t tail = q->tail, room, i;
+
+	room = q->mask + 1 - (tail - q->head_cache);
+	if (room < n) {
+		q->head_cache = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+		room = q->mask + 1 - (tail - q->head_cache);
+	}
+	if (n > room) n = room;
+	for (i = 0; i < n; i++) q->items[(tail + i) & q->mask] = items[i];
+	if (n > 0) __atomic_store_n(&q->tail, tail + n, __ATOMIC_RELEASE);
+	return n;
+}
+
+/**
+ * Pops up to n items into items, returns how many there were. Consumer
+ * thread only.
+ */
+size_t spsc_pop_n(spsc_queue *q, void **items, size_t n) {
+	size_t head = q->head, ready, i;
+
+	ready = q->tail_cache - head;
+	if (ready < n) {
+		q->tail_cache = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+		ready = q->tail_cache - head;
+	}
+	if (n > ready) n = ready;
+	for (i = 0; i < n; i++) items[i] = q->items[(head + i) & q->mask];
+	if (n > 0) __atomic_store_n(&q->head, head + n, __ATOMIC_RELEASE);
+	return n;
+}
+
+/**
+ * Returns 1 on success, 0 if the ring is full
+ */
+int spsc_push(spsc_queue *q, void *item) {
+	return (int)spsc_push_n(q, &item, 1);
+}
+
+/**
+ * Returns 1 and sets *item, or 0 if the ring is empty
+ */
+int spsc_pop(spsc_queue *q, void **item) {
+	return (int)spsc_pop_n(q, item, 1);
+}
+
+void spsc_push_wait(spsc_queue *q, void *item) {
+	unsigned int spins = 0;
+	while (!spsc_push(q, item)) _xqueue_backoff(&spins);
+}
+
+void *spsc_pop_wait(spsc_queue *q) {
+	unsigned int spins = 0;
+	void *item;
+	while (!spsc_pop(q, &item)) _xqueue_backoff(&spins);
+	return item;
+}
+
+void spsc_destroy(spsc_queue *q) {
+	if (q == NULL) return;
+	free(q->items);
+	free(q);
+}
+
+/**
+ * Creates a queue holding capacity items, rounded up to a power of two
+ */
+mpmc_queue *mpmc_init(size_t capacity) {
+	mpmc_queue *q;
+	size_t cap = _xqueue_capacity(capacity), i;
+	if ((q = (mpmc_queue *)_xqueue_alloc(sizeof(mpmc_queue))) == NULL) return NULL;
+	if ((q->cells = (mpmc_cell *)_xqueue_alloc(cap * sizeof(mpmc_cell))) == NULL) { free(q); return NULL; }
+	for (i = 0; i < cap; i++) q->cells[i].seq = i;
+	q->mask = cap - 1;
+	return q;
+}
+
+/**
+ * Pushes up to n items as one contiguous run, returns how many fit
+ */
+size_t mpmc_push_n(mpmc_queue *q, void *const *items, size_t n) {
+	size_t pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED), k, i;
+	mpmc_cell *c;
+
+	if (n == 0) return 0;
+	for (;;) {
+		/* count the free cells from pos, then claim them all at once */
+		for (k = 0; k < n && k <= q->mask; k++)
+			if (__atomic_load_n(&q->cells[(pos + k) & q->mask].seq, __ATOMIC_ACQUIRE) != pos + k) break;
+		if (k == 0) {
+			c = &q->cells[pos & q->mask];
+			if ((intptr_t)(__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE) - pos) < 0) return 0;
+			pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+			continue;
+		}
+		if (__atomic_compare_exchange_n(&q->enqueue_pos, &pos, pos + k, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+	}
+	for (i = 0; i < k; i++) {
+		c = &q->cells[(pos + i) & q->mask];
+		c->data = items[i];
+		__atomic_store_n(&c->seq, pos + i + 1, __ATOMIC_RELEASE);
+	}
+	return k;
+}
+
+/**
+ * Pops up to n items into items as one contiguous run, returns how many
+ * there were
+ */
+size_t mpmc_pop_n(mpmc_queue *q, void **items, size_t n) {
+	size_t pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED), k, i;
+	mpmc_cell *c;
+
+	if (n == 0) return 0;
+	for (;;) {
+		for (k = 0; k < n && k <= q->mask; k++)
+			if (__atomic_load_n(&q->cells[(pos + k) & q->mask].seq, __ATOMIC_ACQUIRE) != pos + k + 1) break;
+		if (k == 0) {
+			c = &q->cells[pos & q->mask];
+			if ((intptr_t)(__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE) - (pos + 1)) < 0) return 0;
+			pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+			continue;
+		}
+		if (__atomic_compare_exchange_n(&q->dequeue_pos, &pos, pos + k, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+	}
+	for (i = 0; i < k; i++) {
+		c = &q->cells[(pos + i) & q->mask];
+		items[i] = c->data;
+		__atomic_store_n(&c->seq, pos + i + q->mask + 1, __ATOMIC_RELEASE);
+	}
+	return k;
+}
+
+/**
+ * Returns 1 on success, 0 if the queue is full
+ */
+int mpmc_push(mpmc_queue *q, void *item) {
+	return (int)mpmc_push_n(q, &item, 1);
+}
+
+/**
+ * Returns 1 and sets *item, or 0 if the queue is empty
+ */
+int mpmc_pop(mpmc_queue *q, void **item) {
+	return (int)mpmc_pop_n(q, item, 1);
+}
+
+void mpmc_push_wait(mpmc_queue *q, void *item) {
+	unsigned int spins = 0;
+	while (!mpmc_push(q, item)) _xqueue_backoff(&spins);
+}
+
+void *mpmc_pop_wait(mpmc_queue *q) {
+	unsigned int spins = 0;
+	void *item;
+	while (!mpmc_pop(q, &item)) _xqueue_backoff(&spins);
+	return item;
+}
+
+void mpmc_destroy(mpmc_queue *q) {
+	if (q == NULL) return;
+	free(q->cells);
+	free(q);
+}
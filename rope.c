@@ -0,0 +1,573 @@
+/********************************************************************
+ * Name: rope.c
+ * Author: rashaudteague
+ * License: GNU LGPL <http://www.gnu.org/licenses/>
+ * Description: Ropes for editing large texts in place
+ ********************************************************************/
+
+#include "xstdlib.h"
+
+/*
+ * A rope is a treap ordered by position: every node holds one chunk of up
+ * to ROPE_CHUNK bytes and the byte count of its subtree, and random heap
+ * priorities keep the tree balanced in expectation. Splitting and merging
+ * are O(log n), everything else is built from them.
+ */
+
+#define _rope_size(n) ((n) != NULL ? (n)->size : 0)
+/* chunks are built part full so small inserts usually land in place */
+#define ROPE_CHUNK_FILL (ROPE_CHUNK / 4 * 3)
+
+static unsigned int _rope_priority(rope *r) {
+	/* xorshift32 */
+	r->seed ^= r->seed << 13;
+	r->seed ^= r->seed >> 17;
+	r->seed ^= r->seed << 5;
+	return r->seed;
+}
+
+static rope_node *_rope_node(rope *r, const char *s, size_t len) {
+	rope_node *n;
+	if ((n = (rope_node *)xalloc(r->allocator, sizeof(rope_node))) == NULL) return NULL;
+	n->left = n->right = NULL;
+	n->priority = _rope_priority(r);
+	memcpy(n->data, s, len);
+	n->len = n->size = len;
+	return n;
+}
+
+static void _rope_update(rope_node *n) {
+	n->size = _rope_size(n->left) + n->len + _rope_size(n->right);
+}
+
+static void _rope_free(const xallocator *a, rope_node *n) {
+	if (n == NULL) return;
+	_rope_free(a, n->left);
+	_rope_free(a, n->right);
+	xalloc_free(a, n);
+}
+
+static rope_node *_rope_merge(rope_node *a, rope_node *b) {
+	if (a == NULL) return b;
+	if (b == NULL) return a;
+	if (a->priority >= b->priority) {
+		a->right = _rope_merge(a->right, b);
+		_rope_update(a);
+		return a;
+	}
+	b->left = _rope_merge(a, b->left);
+	_rope_update(b);
+	return b;
+}
+
+/**
+ * _rope_merge() that first folds the first chunk of b into the last chunk
+ * of a when the two fit in one, so the seams cuts leave behind do not
+ * pile up short chunks
+ */
+static rope_node *_rope_join(rope *r, rope_node *a, rope_node *b) {
+	rope_node *last, *first, **link, *t;
+
+	if (a == NULL) return b;
+	if (b == NULL) return a;
+	for (last = a; last->right != NULL; last = last->right);
+	for (first = b; first->left != NULL; first = first->left);
+	if (last->len + first->len <= ROPE_CHUNK) {
+		memcpy(last->data + last->len, first->data, first->len);
+		last->len += first->len;
+		for (t = a; t != NULL; t = t->right) t->size += first->len;
+		/* first has no left child, its right one takes its place */
+		for (link = &b; *link != first; link = &(*link)->left) (*link)->size -= first->len;
+		*link = first->right;
+		xalloc_free(r->allocator, first);
+	}
+	return _rope_merge(a, b);
+}
+
+/**
+ * Splits t into its first k bytes and the rest. A cut inside a chunk moves
+ * the chunk's tail into *spare, which the caller allocates up front so a
+ * failed allocation never leaves the tree half split; *spare is NULLed if used.
+ */
+static void _rope_split(rope_node *t, size_t k, rope_node **l, rope_node **r, rope_node **spare) {
+	rope_node *tail;
+	size_t left;
+
+	if (t == NULL) { *l = *r = NULL; return; }
+	left = _rope_size(t->left);
+	if (k <= left) {
+		_rope_split(t->left, k, l, &t->left, spare);
+		_rope_update(t);
+		*r = t;
+	} else if (k >= left + t->len) {
+		_rope_split(t->right, k - left - t->len, &t->right, r, spare);
+		_rope_update(t);
+		*l = t;
+	} else {
+		/* the tail takes t's priority so both halves stay valid heaps */
+		tail = *spare;
+		*spare = NULL;
+		k -= left;
+		memcpy(tail->data, t->data + k, t->len - k);
+		tail->len = t->len - k;
+		tail->priority = t->priority;
+		tail->left = NULL;
+		tail->right = t->right;
+		t->len = k;
+		t->right = NULL;
+		_rope_update(tail);
+		_rope_update(t);
+		*l = t;
+		*r = tail;
+	}
+}
+
+/**
+ * Splits at k, returns 0 if out of memory (the tree is left untouched)
+ */
+static int _rope_cut(rope *r, size_t k, rope_node **left, rope_node **right) {
+	rope_node *spare;
+	if ((spare = (rope_node *)xalloc(r->allocator, sizeof(rope_node))) == NULL) return 0;
+	_rope_split(r->root, k, left, right, &spare);
+	r->root = NULL;
+	xalloc_free(r->allocator, spare);
+	return 1;
+}
+
+/**
+ * Builds a treap holding s, NULL with *ok cleared if out of memory
+ */
+static rope_node *_rope_build(rope *r, const char *s, size_t len, int *ok) {
+	rope_node *t = NULL, *n;
+	size_t take;
+	*ok = 1;
+	while (len > 0) {
+		take = len < ROPE_CHUNK_FILL ? len : ROPE_CHUNK_FILL;
+		if ((n = _rope_node(r, s, take)) == NULL) {
+			_rope_free(r->allocator, t);
+			*ok = 0;
+			return NULL;
+		}
+		t = _rope_merge(t, n);
+		s += take;
+		len -= take;
+	}
+	return t;
+}
+
+/**
+ * Inserts into the chunk holding pos when it has room, fixing the sizes on
+ * the way back up. Returns 0 if no chunk on the path can take it.
+ */
+static int _rope_insert_in_place(rope_node *t, size_t pos, const char *s, size_t len) {
+	size_t left;
+	int done = 0;
+
+	if (t == NULL) return 0;
+	left = _rope_size(t->left);
+	if (pos < left) {
+		done = _rope_insert_in_place(t->left, pos, s, len);
+	} else if (pos > left + t->len) {
+		done = _rope_insert_in_place(t->right, pos - left - t->len, s, len);
+	} else if (t->len + len <= ROPE_CHUNK) {
+		pos -= left;
+		memmove(t->data + pos + len, t->data + pos, t->len - pos);
+		memcpy(t->data + pos, s, len);
+		t->len += len;
+		done = 1;
+	} else if (pos == left) {
+		/* the end of the previous chunk is the same position */
+		done = _rope_insert_in_place(t->left, pos, s, len);
+	} else if (pos == left + t->len) {
+		done = _rope_insert_in_place(t->right, 0, s, len);
+	}
+	if (done) t->size += len;
+	return done;
+}
+
+/**
+ * Removes a range lying inside one chunk, fixing the sizes on the way back
+ * up. A chunk left empty is unlinked and freed, otherwise *chunk and *start
+ * say which one it was and where it begins. Returns 0 if the range spans
+ * chunks.
+ */
+static int _rope_delete_in_place(rope *r, rope_node **link, size_t pos, size_t len, rope_node **chunk, size_t *start) {
+	rope_node *t = *link;
+	size_t left;
+	int done = 0;
+
+	if (t == NULL) return 0;
+	left = _rope_size(t->left);
+	if (pos < left) {
+		done = _rope_delete_in_place(r, &t->left, pos, len, chunk, start);
+	} else if (pos >= left + t->len) {
+		if ((done = _rope_delete_in_place(r, &t->right, pos - left - t->len, len, chunk, start))) *start += left + t->len;
+	} else if (pos - left + len <= t->len) {
+		if (len == t->len) {
+			*link = _rope_merge(t->left, t->right);
+			*chunk = NULL;
+			xalloc_free(r->allocator, t);
+			return 1;
+		}
+		pos -= left;
+		memmove(t->data + pos, t->data + pos + len, t->len - pos - len);
+		t->len -= len;
+		*chunk = t;
+		*start = left;
+		done = 1;
+	}
+	if (done) t->size -= len;
+	return done;
+}
+
+/**
+ * The chunk holding byte pos
+ */
+static rope_node *_rope_chunk_at(rope_node *t, size_t pos) {
+	size_t left;
+	while (t != NULL) {
+		left = _rope_size(t->left);
+		if (pos < left) {
+			t = t->left;
+		} else if (pos >= left + t->len) {
+			pos -= left + t->len;
+			t = t->right;
+		} else {
+			break;
+		}
+	}
+	return t;
+}
+
+/**
+ * Folds a chunk an in-place delete left short into a neighbour with room
+ * for it. Cutting at chunk edges never needs a spare.
+ */
+static void _rope_settle(rope *r, rope_node *chunk, size_t start) {
+	rope_node *prev = NULL, *next, *left, *mid, *right, *spare = NULL;
+	size_t len = chunk->len;
+
+	if (start > 0) prev = _rope_chunk_at(r->root, start - 1);
+	next = _rope_chunk_at(r->root, start + len);
+	if ((prev == NULL || prev->len + len > ROPE_CHUNK) && (next == NULL || next->len + len > ROPE_CHUNK)) return;
+	_rope_split(r->root, start, &left, &right, &spare);
+	_rope_split(right, len, &mid, &right, &spare);
+	r->root = _rope_join(r, _rope_join(r, left, mid), right);
+}
+
+rope *rope_init_n(const char *s, size_t len) {
+	return rope_init_n_a(NULL, s, len);
+}
+
+rope *rope_init(const char *s) {
+	return rope_init_n_a(NULL, s, s != NULL ? strlen(s) : 0);
+}
+
+/**
+ * Creates a rope holding len bytes of s, taking its nodes from allocator a
+ */
+rope *rope_init_n_a(const xallocator *a, const char *s, size_t len) {
+	rope *r;
+	int ok;
+	if ((r = (rope *)xalloc(a, sizeof(rope))) == NULL) return NULL;
+	r->allocator = a;
+	r->seed = 0x9E3779B9u ^ (unsigned int)(uintptr_t)r;
+	if (r->seed == 0) r->seed = 1;
+	r->root = _rope_build(r, s, len, &ok);
+	if (!ok) { xalloc_free(a, r); return NULL; }
+	return r;
+}
+
+rope *rope_init_a(const xallocator *a, const char *s) {
+	return rope_init_n_a(a, s, s != NULL ? strlen(s) : 0);
+}
+
+size_t rope_length(const rope *r) {
+	return _rope_size(r->root);
+}
+
+/**
+ * Inserts len bytes of s at pos, returns 1 on success or 0 if pos is past
+ * the end or out of memory
+ */
+int rope_insert(rope *r, size_t pos, const char *s, size_t len) {
+	rope_node *left, *mid, *right;
+	int ok;
+
+	if (pos > rope_length(r)) return 0;
+	if (len == 0) return 1;
+	if (len <= ROPE_CHUNK && _rope_insert_in_place(r->root, pos, s, len)) return 1;
+
+	mid = _rope_build(r, s, len, &ok);
+	if (!ok) return 0;
+	if (!_rope_cut(r, pos, &left, &right)) { _rope_free(r->allocator, mid); return 0; }
+	r->root = _rope_join(r, _rope_join(r, left, mid), right);
+	return 1;
+}
+
+/**
+ * Removes len bytes from pos (clamped to the end), returns 0 if out of memory
+ */
+int rope_delete(rope *r, size_t pos, size_t len) {
+	rope_node *left, *mid, *right, *spare, *chunk;
+	size_t size = rope_length(r), start;
+
+	if (pos >= size || len == 0) return 1;
+	if (len > size - pos) len = size - pos;
+	if (_rope_delete_in_place(r, &r->root, pos, len, &chunk, &start)) {
+		if (chunk != NULL && chunk->len <= ROPE_CHUNK / 2) _rope_settle(r, chunk, start);
+		return 1;
+	}
+	if ((spare = (rope_node *)xalloc(r->allocator, sizeof(rope_node))) == NULL) return 0;
+	if (!_rope_cut(r, pos, &left, &right)) { xalloc_free(r->allocator, spare); return 0; }
+	_rope_split(right, len, &mid, &right, &spare);
+	xalloc_free(r->allocator, spare);
+	_rope_free(r->allocator, mid);
+	r->root = _rope_join(r, left, right);
+	return 1;
+}
+
+/**
+ * Appends other's text to r, leaving other empty. Both must take their
+ * nodes from the same allocator.
+ */
+void rope_concat(rope *r, rope *other) {
+	r->root = _rope_join(r, r->root, other->root);
+	other->root = NULL;
+}
+
+static void _rope_copy(const rope_node *t, size_t pos, size_t len, char *out) {
+	size_t left, from, n;
+	while (t != NULL && len > 0) {
+		left = _rope_size(t->left);
+		if (pos < left) {
+			n = left - pos < len ? left - pos : len;
+			_rope_copy(t->left, pos, n, out);
+			out += n;
+			pos += n;
+			len -= n;
+		}
+		if (len == 0) break;
+		if (pos < left + t->len) {
+			from = pos - left;
+			n = t->len - from < len ? t->len - from : len;
+			memcpy(out, t->data + from, n);
+			out += n;
+			pos += n;
+			len -= n;
+		}
+		pos -= left + t->len;
+		t = t->right;
+	}
+}
+
+/**
+ * Copies len bytes from pos (clamped to the end) into buffer and terminates it
+ */
+char *rope_substr(const rope *r, size_t pos, size_t len, char *buffer) {
+	size_t size = rope_length(r);
+	if (pos > size) pos = size;
+	if (len > size - pos) len = size - pos;
+	_rope_copy(r->root, pos, len, buffer);
+	buffer[len] = '\0';
+	return buffer;
+}
+
+/**
+ * Copies the whole text into buffer, which needs rope_length() + 1 bytes
+ */
+char *rope_flatten(const rope *r, char *buffer) {
+	return rope_substr(r, 0, rope_length(r), buffer);
+}
+
+/**
+ * Calls fn on every chunk in order, stops early when fn returns nonzero
+ */
+static int _rope_walk(rope_node *t, int (*fn)(char *data, size_t len, void *arg), void *arg) {
+	while (t != NULL) {
+		if (_rope_walk(t->left, fn, arg)) return 1;
+		if (t->len > 0 && fn(t->data, t->len, arg)) return 1;
+		t = t->right;
+	}
+	return 0;
+}
+
+typedef struct __rope_search__ {
+	const char *needle;
+	size_t nlen;
+	char *window;          /* the last nlen - 1 bytes seen, then the next chunk's head */
+	size_t carry;
+	size_t base;           /* position of the chunk being searched */
+	size_t next;           /* matches may not start before here (no overlaps) */
+	int (*hit)(size_t pos, void *arg);
+	void *arg;
+} _rope_search;
+
+static const char *_rope_memmem(const char *p, size_t len, const char *needle, size_t nlen) {
+	const char *end = p + len - nlen + 1;
+	while (p < end && (p = (const char *)memchr(p, needle[0], end - p)) != NULL) {
+		if (memcmp(p, needle, nlen) == 0) return p;
+		p++;
+	}
+	return NULL;
+}
+
+static int _rope_search_matches(_rope_search *s, const char *data, size_t len, size_t start, size_t limit) {
+	const char *p = data, *end = data + len, *m;
+	size_t pos;
+	while ((size_t)(end - p) >= s->nlen && (m = _rope_memmem(p, end - p, s->needle, s->nlen)) != NULL) {
+		pos = start + (m - data);
+		if (m - data >= (ptrdiff_t)limit) break;
+		if (pos >= s->next) {
+			if (s->hit(pos, s->arg)) return 1;
+			s->next = pos + s->nlen;
+			p = m + s->nlen;
+		} else {
+			p = m + 1;
+		}
+	}
+	return 0;
+}
+
+static int _rope_search_chunk(char *data, size_t len, void *arg) {
+	_rope_search *s = (_rope_search *)arg;
+	size_t head, keep;
+
+	/* matches that start in the carried tail and run into this chunk */
+	if (s->carry > 0) {
+		head = len < s->nlen - 1 ? len : s->nlen - 1;
+		memcpy(s->window + s->carry, data, head);
+		if (_rope_search_matches(s, s->window, s->carry + head, s->base - s->carry, s->carry)) return 1;
+	}
+	if (_rope_search_matches(s, data, len, s->base, len)) return 1;
+
+	/* keep the last nlen - 1 bytes for the next boundary */
+	keep = s->nlen - 1;
+	if (len >= keep) {
+		memcpy(s->window, data + len - keep, keep);
+		s->carry = keep;
+	} else {
+		if (s->carry + len > keep) {
+			memmove(s->window, s->window + s->carry + len - keep, keep - len);
+			s->carry = keep - len;
+		}
+		memcpy(s->window + s->carry, data, len);
+		s->carry += len;
+	}
+	s->base += len;
+	return 0;
+}
+
+/**
+ * Reports every non-overlapping match of needle to hit(), in order.
+ * Returns -1 if out of memory, otherwise 0.
+ */
+static int _rope_find(const rope *r, const char *needle, int (*hit)(size_t pos, void *arg), void *arg) {
+	_rope_search s;
+	s.needle = needle;
+	s.nlen = strlen(needle);
+	s.carry = s.base = s.next = 0;
+	s.hit = hit;
+	s.arg = arg;
+	if (s.nlen == 0) return 0;
+	if ((s.window = (char *)xalloc(r->allocator, 2 * s.nlen)) == NULL) return -1;
+	_rope_walk(r->root, _rope_search_chunk, &s);
+	xalloc_free(r->allocator, s.window);
+	return 0;
+}
+
+typedef struct __rope_nth__ {
+	int skip;
+	long pos;
+} _rope_nth;
+
+static int _rope_nth_hit(size_t pos, void *arg) {
+	_rope_nth *n = (_rope_nth *)arg;
+	if (n->skip-- > 0) return 0;
+	n->pos = (long)pos;
+	return 1;
+}
+
+/**
+ * strpos() over a rope: the position of the first match of needle after
+ * skipping offset earlier ones, or -1
+ */
+long rope_strpos(const rope *r, const char *needle, int offset) {
+	_rope_nth n;
+	n.skip = offset;
+	n.pos = -1;
+	if (_rope_find(r, needle, _rope_nth_hit, &n) == -1) return -1;
+	return n.pos;
+}
+
+typedef struct __rope_hits__ {
+	const xallocator *allocator;
+	size_t *pos;
+	size_t count;
+	size_t cap;
+	int failed;
+} _rope_hits;
+
+static int _rope_collect_hit(size_t pos, void *arg) {
+	_rope_hits *h = (_rope_hits *)arg;
+	size_t *grown, cap;
+	if (h->count == h->cap) {
+		cap = h->cap > 0 ? h->cap * 2 : 64;
+		if ((grown = (size_t *)xalloc_resize(h->allocator, h->pos, h->cap * sizeof(size_t), cap * sizeof(size_t))) == NULL) { h->failed = 1; return 1; }
+		h->pos = grown;
+		h->cap = cap;
+	}
+	h->pos[h->count++] = pos;
+	return 0;
+}
+
+/**
+ * Replaces every non-overlapping occurrence of find, returns the number of
+ * replacements or -1 if out of memory. Each one costs O(log n).
+ */
+long rope_replace(rope *r, const char *find, const char *replace) {
+	_rope_hits h;
+	size_t find_len = strlen(find), replace_len = strlen(replace), i;
+	long done = 0;
+
+	memset(&h, 0, sizeof(h));
+	h.allocator = r->allocator;
+	if (_rope_find(r, find, _rope_collect_hit, &h) == -1 || h.failed) { xalloc_free(r->allocator, h.pos); return -1; }
+	/* back to front so the earlier positions stay valid */
+	for (i = h.count; i-- > 0; done++) {
+		if (!rope_delete(r, h.pos[i], find_len) || !rope_insert(r, h.pos[i], replace, replace_len)) {
+			done = -1;
+			break;
+		}
+	}
+	xalloc_free(r->allocator, h.pos);
+	return done;
+}
+
+static int _rope_upper(char *data, size_t len, void *arg) {
+	size_t i;
+	for (i = 0; i < len; i++)
+		if (data[i] >= 'a' && data[i] <= 'z') data[i] -= 'a' - 'A';
+	return 0;
+}
+
+static int _rope_lower(char *data, size_t len, void *arg) {
+	size_t i;
+	for (i = 0; i < len; i++)
+		if (data[i] >= 'A' && data[i] <= 'Z') data[i] += 'a' - 'A';
+	return 0;
+}
+
+void rope_toupper(rope *r) {
+	_rope_walk(r->root, _rope_upper, NULL);
+}
+
+void rope_tolower(rope *r) {
+	_rope_walk(r->root, _rope_lower, NULL);
+}
+
+void rope_destroy(rope *r) {
+	if (r == NULL) return;
+	_rope_free(r->allocator, r->root);
+	xalloc_free(r->allocator, r);
+}
@@ -0,0 +1,613 @@
+/********************************************************************
+ * Name: serialize.c
+ * Author: rashaudteague
+ * License: GNU LGPL <http://www.gnu.org/licenses/>
+ * Description: Buffered JSON/NDJSON writers for lists, vectors and hash tables
+ ********************************************************************/
+
+#include "xstdlib.h"
+
+static const char _xwriter_digits[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+static void _xwriter_init(xwriter *w, size_t chunk) {
+	w->buf = NULL;
+	w->len = 0;
+	w->cap = chunk > 0 ? chunk : XWRITER_CHUNK_SIZE;
+	w->fd = -1;
+	w->sink = NULL;
+	w->arg = NULL;
+	w->error = 0;
+	w->grow = 0;
+	if ((w->buf = (char *)malloc(w->cap)) == NULL) w->error = 1;
+}
+
+/**
+ * A writer that collects everything in w->buf (w->len bytes, not
+ * terminated until xwriter_flush())
+ */
+void xwriter_mem(xwriter *w) {
+	_xwriter_init(w, 0);
+	w->grow = 1;
+}
+
+/**
+ * A writer that write()s to fd in chunks of at most chunk bytes (0 for
+ * XWRITER_CHUNK_SIZE)
+ */
+void xwriter_fd(xwriter *w, int fd, size_t chunk) {
+	_xwriter_init(w, chunk);
+	w->fd = fd;
+}
+
+/**
+ * A writer that hands sink() chunks of at most chunk bytes; a nonzero
+ * return from sink() stops the writer
+ */
+void xwriter_sink(xwriter *w, int (*sink)(const char *data, size_t len, void *arg), void *arg, size_t chunk) {
+	_xwriter_init(w, chunk);
+	w->sink = sink;
+	w->arg = arg;
+}
+
+static int _xwriter_drain(xwriter *w) {
+	size_t done = 0;
+	ssize_t n;
+
+	if (w->error) return 0;
+	if (w->sink != NULL) {
+		if (w->len > 0 && w->sink(w->buf, w->len, w->arg) != 0) w->error = 1;
+	} else if (w->fd >= 0) {
+		while (done < w->len) {
+			if ((n = write(w->fd, w->buf + done, w->len - done)) < 0) {
+				if (errno == EINTR) continue;
+				w->error = 1;
+				break;
+			}
+			done += n;
+		}
+	}
+	w->len = 0;
+	return !w->error;
+}
+
+void xwriter_write(xwriter *w, const char *data, size_t len) {
+	size_t n;
+	char *grown;
+
+	while (len > 0 && !w->error) {
+		if (w->len == w->cap) {
+			if (!w->grow) { _xwriter_drain(w); continue; }
+			if ((grown = (char *)realloc(w->buf, w->cap * 2)) == NULL) { w->error = 1; return; }
+			w->buf = grown;
+			w->cap *= 2;
+		}
+		n = w->cap - w->len < len ? w->cap - w->len : len;
+		memcpy(w->buf + w->len, data, n);
+		w->len += n;
+		data += n;
+		len -= n;
+	}
+}
+
+void xwriter_putc(xwriter *w, char c) {
+	if (w->len == w->cap || w->error) { xwriter_write(w, &c, 1); return; }
+	w->buf[w->len++] = c;
+}
+
+/**
+ * Writes s as a quoted JSON string
+ */
+void xwriter_string(xwriter *w, const char *s, size_t len) {
+	static const char hex[] = "0123456789abcdef";
+	const char *run = s, *end = s + len;
+	char esc[6] = { '\\', 'u', '0', '0', 0, 0 };
+
+	xwriter_putc(w, '"');
+	for (; s < end; s++) {
+		unsigned char c = (unsigned char)*s;
+		if (c >= 0x20 && c != '"' && c != '\\') continue;
+		xwriter_write(w, run, s - run);
+		run = s + 1;
+		switch (c) {
+			case '"': xwriter_write(w, "\\\"", 2); break;
+			case '\\': xwriter_write(w, "\\\\", 2); break;
+			case '\n': xwriter_write(w, "\\n", 2); break;
+			case '\r': xwriter_write(w, "\\r", 2); break;
+			case '\t': xwriter_write(w, "\\t", 2); break;
+			default:
+				esc[4] = hex[c >> 4];
+				esc[5] = hex[c & 15];
+				xwriter_write(w, esc, 6);
+		}
+	}
+	xwriter_write(w, run, end - run);
+	xwriter_putc(w, '"');
+}
+
+void xwriter_uint(xwriter *w, unsigned long long v) {
+	char buffer[24], *p = buffer + sizeof(buffer);
+	while (v >= 100) {
+		p -= 2;
+		memcpy(p, _xwriter_digits + (v % 100) * 2, 2);
+		v /= 100;
+	}
+	if (v >= 10) {
+		p -= 2;
+		memcpy(p, _xwriter_digits + v * 2, 2);
+	} else {
+		*--p = (char)('0' + v);
+	}
+	xwriter_write(w, p, buffer + sizeof(buffer) - p);
+}
+
+void xwriter_int(xwriter *w, long long v) {
+	if (v < 0) {
+		xwriter_putc(w, '-');
+		xwriter_uint(w, 0ULL - (unsigned long long)v);
+	} else {
+		xwriter_uint(w, (unsigned long long)v);
+	}
+}
+
+/*
+ * Shortest round-trip formatting of doubles and floats, Grisu2 after
+ * Florian Loitsch, "Printing Floating-Point Numbers Quickly and Accurately
+ * with Integers". The value and the midpoints to its neighbours are scaled
+ * by a cached power of ten into 64-bit fixed point, and digits are emitted
+ * until the number is inside those midpoints, so it reads back exactly.
+ */
+typedef struct __xwriter_fp__ {
+	uint64_t f;
+	int e;
+} _xwriter_fp;
+
+static const uint64_t _xwriter_pow_f[87] = {
+	0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+	0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+	0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+	0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+	0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+	0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+	0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+	0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+	0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+	0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+	0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+	0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+	0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+	0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+	0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+	0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+	0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+	0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+	0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+	0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+	0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+	0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+	0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+	0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+	0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+	0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+	0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+	0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+	0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+
+static const short _xwriter_pow_e[87] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+	-901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+	-582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+	-263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+	56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+	375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+	694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+	1013, 1039, 1066,
+};
+
+static const uint32_t _xwriter_pow10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+
+static _xwriter_fp _xwriter_fp_mul(_xwriter_fp a, _xwriter_fp b) {
+	unsigned __int128 p = (unsigned __int128)a.f * b.f;
+	_xwriter_fp r;
+	r.f = (uint64_t)(p >> 64) + ((uint64_t)p >> 63);
+	r.e = a.e + b.e + 64;
+	return r;
+}
+
+static _xwriter_fp _xwriter_fp_normalize(_xwriter_fp a) {
+	int s = __builtin_clzll(a.f);
+	a.f <<= s;
+	a.e -= s;
+	return a;
+}
+
+static void _xwriter_grisu_round(char *buffer, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w) {
+	while (rest < wp_w && delta - rest >= ten_kappa
+			&& (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+		buffer[len - 1]--;
+		rest += ten_kappa;
+	}
+}
+
+/**
+ * Digits of f * 2^e, whose neighbours are closer than usual below when
+ * lower_closer is set (f is a power of two). Returns the digit count and
+ * sets *k so the value is digits * 10^k.
+ */
+static int _xwriter_grisu(uint64_t f, int e, int lower_closer, char *buffer, int *k) {
+	_xwriter_fp v = { f, e }, plus = { (f << 1) + 1, e - 1 }, minus, c, w, one;
+	uint64_t p2, delta, wp_w, rest;
+	uint32_t p1, d;
+	int kappa, len = 0, index;
+	double dk;
+
+	plus = _xwriter_fp_normalize(plus);
+	if (lower_closer) { minus.f = (f << 2) - 1; minus.e = e - 2; }
+	else { minus.f = (f << 1) - 1; minus.e = e - 1; }
+	minus.f <<= minus.e - plus.e;
+	minus.e = plus.e;
+
+	/* the cached power that brings plus's exponent into [-60, -32] */
+	dk = (-61 - plus.e) * 0.30102999566398114 + 347;
+	index = (int)dk;
+	if (dk - index > 0.0) index++;
+	index = (index >> 3) + 1;
+	*k = -(-348 + index * 8);
+	c.f = _xwriter_pow_f[index];
+	c.e = _xwriter_pow_e[index];
+
+	w = _xwriter_fp_mul(_xwriter_fp_normalize(v), c);
+	plus = _xwriter_fp_mul(plus, c);
+	minus = _xwriter_fp_mul(minus, c);
+	minus.f++;
+	plus.f--;
+	delta = plus.f - minus.f;
+	wp_w = plus.f - w.f;
+
+	one.e = plus.e;
+	one.f = (uint64_t)1 << -one.e;
+	p1 = (uint32_t)(plus.f >> -one.e);
+	p2 = plus.f & (one.f - 1);
+	for (kappa = 1; kappa < 10 && p1 >= _xwriter_pow10[kappa]; kappa++);
+	while (kappa > 0) {
+		d = p1 / _xwriter_pow10[kappa - 1];
+		p1 %= _xwriter_pow10[kappa - 1];
+		if (d || len) buffer[len++] = (char)('0' + d);
+		kappa--;
+		rest = ((uint64_t)p1 << -one.e) + p2;
+		if (rest <= delta) {
+			*k += kappa;
+			_xwriter_grisu_round(buffer, len, delta, rest, (uint64_t)_xwriter_pow10[kappa] << -one.e, wp_w);
+			return len;
+		}
+	}
+	for (;;) {
+		p2 *= 10;
+		delta *= 10;
+		d = (uint32_t)(p2 >> -one.e);
+		if (d || len) buffer[len++] = (char)('0' + d);
+		p2 &= one.f - 1;
+		kappa--;
+		if (p2 < delta) {
+			*k += kappa;
+			index = -kappa;
+			_xwriter_grisu_round(buffer, len, delta, p2, one.f, wp_w * (index < 10 ? _xwriter_pow10[index] : 0));
+			return len;
+		}
+	}
+}
+
+/**
+ * Lays out len digits times 10^k as JSON: plain up to 21 integer digits
+ * or 6 leading zeros, exponent notation beyond. Returns the length.
+ */
+static int _xwriter_prettify(char *buffer, int len, int k) {
+	int kk = len + k, exp, i;
+
+	if (k >= 0 && kk <= 21) {
+		memset(buffer + len, '0', k);
+		return kk;
+	}
+	if (kk > 0 && kk <= 21) {
+		memmove(buffer + kk + 1, buffer + kk, len - kk);
+		buffer[kk] = '.';
+		return len + 1;
+	}
+	if (kk > -6 && kk <= 0) {
+		memmove(buffer + 2 - kk, buffer, len);
+		buffer[0] = '0';
+		buffer[1] = '.';
+		memset(buffer + 2, '0', -kk);
+		return len + 2 - kk;
+	}
+	if (len > 1) {
+		memmove(buffer + 2, buffer + 1, len - 1);
+		buffer[1] = '.';
+		len++;
+	}
+	buffer[len++] = 'e';
+	exp = kk - 1;
+	if (exp < 0) { buffer[len++] = '-'; exp = -exp; }
+	if (exp >= 100) { buffer[len++] = (char)('0' + exp / 100); exp %= 100; i = 1; }
+	else i = 0;
+	if (exp >= 10 || i) { buffer[len++] = (char)('0' + exp / 10); exp %= 10; }
+	buffer[len++] = (char)('0' + exp);
+	return len;
+}
+
+/**
+ * Shortest digits that read back as v, for a double or a float (bits 24)
+ */
+static int _xwriter_shortest(double v, int bits, char *buffer) {
+	uint64_t u, f;
+	uint32_t u32;
+	int e, len, k, neg;
+	float fv;
+
+	if (bits == 24) {
+		fv = (float)v;
+		memcpy(&u32, &fv, sizeof(u32));
+		neg = u32 >> 31;
+		f = u32 & 0x7FFFFF;
+		e = (u32 >> 23) & 0xFF;
+		if (e != 0) { f |= 0x800000; e -= 150; } else e = -149;
+	} else {
+		memcpy(&u, &v, sizeof(u));
+		neg = (int)(u >> 63);
+		f = u & 0xFFFFFFFFFFFFFULL;
+		e = (int)((u >> 52) & 0x7FF);
+		if (e != 0) { f |= 0x10000000000000ULL; e -= 1075; } else e = -1074;
+	}
+	if (neg) *buffer++ = '-';
+	if (f == 0) {
+		buffer[0] = '0';
+		return neg + 1;
+	}
+	len = _xwriter_grisu(f, e, f == (uint64_t)1 << (bits - 1) && e > (bits == 24 ? -149 : -1074), buffer, &k);
+	return neg + _xwriter_prettify(buffer, len, k);
+}
+
+/**
+ * Writes a number that reads back to the same value; integral values take
+ * the integer path, NaN and infinities become null since JSON has neither.
+ * digits is 9 for a float and 17 for a double, which get their shortest
+ * form without printf; anything else goes through snprintf("%.*Lg").
+ */
+void xwriter_double(xwriter *w, long double v, int digits) {
+	char buffer[64];
+	int n;
+
+	if (isnan(v) || isinf(v)) { xwriter_write(w, "null", 4); return; }
+	if (fabsl(v) < 9007199254740992.0L && v == (long double)(long long)v && !(v == 0 && signbit(v))) {
+		xwriter_int(w, (long long)v);
+		return;
+	}
+	if (digits == 9 || digits == 17) n = _xwriter_shortest((double)v, digits == 9 ? 24 : 53, buffer);
+	else n = snprintf(buffer, sizeof(buffer), "%.*Lg", digits, v);
+	xwriter_write(w, buffer, n);
+}
+
+int xwriter_flush(xwriter *w) {
+	if (w->grow) {
+		/* keep the memory buffer terminated without counting the NUL */
+		xwriter_putc(w, '\0');
+		if (!w->error) w->len--;
+		return !w->error;
+	}
+	return _xwriter_drain(w);
+}
+
+/**
+ * Flushes and frees the writer, returns 0 if anything failed. A memory
+ * writer's buffer is left to the caller in w->buf.
+ */
+int xwriter_close(xwriter *w) {
+	int ok = xwriter_flush(w);
+	if (!w->grow) {
+		free(w->buf);
+		w->buf = NULL;
+	}
+	return ok;
+}
+
+static void _serialize_value(xwriter *w, const void *data, unsigned short type) {
+	if (data == NULL) { xwriter_write(w, "null", 4); return; }
+	switch (type) {
+		case CHAR: xwriter_string(w, (const char *)data, 1); break;
+		case STRING: xwriter_string(w, (const char *)data, strlen((const char *)data)); break;
+		case SHORT: xwriter_int(w, *(const short *)data); break;
+		case USHORT: xwriter_uint(w, *(const unsigned short *)data); break;
+		case INT: xwriter_int(w, *(const int *)data); break;
+		case UINT: xwriter_uint(w, *(const unsigned int *)data); break;
+		case LONG: xwriter_int(w, *(const long *)data); break;
+		case ULONG: xwriter_uint(w, *(const unsigned long *)data); break;
+		case LONGLONG: xwriter_int(w, *(const long long *)data); break;
+		case ULONGLONG: xwriter_uint(w, *(const unsigned long long *)data); break;
+		case FLOAT: xwriter_double(w, *(const float *)data, 9); break;
+		case DOUBLE: xwriter_double(w, *(const double *)data, 17); break;
+		case LONGDOUBLE: xwriter_double(w, *(const long double *)data, 21); break;
+		default: xwriter_write(w, "null", 4);
+	}
+}
+
+/**
+ * Elements with their own print callback are written as null, unless
+ * XSERIAL_PRINT_CALLBACKS is set and the writer goes to stdout.
+ */
+static int _serialize_callback(xwriter *w, void (*print)(void *v), void *arg, unsigned short flags) {
+	if (print == NULL) return 0;
+	if ((flags & XSERIAL_PRINT_CALLBACKS) && w->fd == STDOUT_FILENO) {
+		_xwriter_drain(w);
+		print(arg);
+		fflush(stdout);
+	} else {
+		xwriter_write(w, "null", 4);
+	}
+	return 1;
+}
+
+/**
+ * Writes the list as a JSON array, or one value per line with XSERIAL_NDJSON
+ */
+int list_serialize(xwriter *w, list *l, unsigned short flags) {
+	list_element *e;
+	int ndjson = flags & XSERIAL_NDJSON;
+
+	if (!ndjson) xwriter_putc(w, '[');
+	for (e = l->head; e != NULL && !w->error; e = e->next) {
+		if (!ndjson && e != l->head) xwriter_putc(w, ',');
+		if (!_serialize_callback(w, e->print, e, flags)) _serialize_value(w, e->data, e->type);
+		if (ndjson) xwriter_putc(w, '\n');
+	}
+	if (!ndjson) xwriter_putc(w, ']');
+	return !w->error;
+}
+
+/**
+ * Writes the first size buckets as a JSON object, or one {"key": value}
+ * object per line with XSERIAL_NDJSON
+ */
+int hash_serialize(xwriter *w, hashtab *h[], unsigned int size, unsigned short flags) {
+	hashtab *entry;
+	unsigned int i;
+	int ndjson = flags & XSERIAL_NDJSON, first = 1;
+
+	if (!ndjson) xwriter_putc(w, '{');
+	for (i = 0; i < size && !w->error; i++) {
+		for (entry = h[i]; entry != NULL; entry = entry->next) {
+			if (ndjson) xwriter_putc(w, '{');
+			else if (!first) xwriter_putc(w, ',');
+			first = 0;
+			xwriter_string(w, entry->key, strlen(entry->key));
+			xwriter_putc(w, ':');
+			if (!_serialize_callback(w, entry->print, entry, flags)) _serialize_value(w, entry->val, entry->type);
+			if (ndjson) xwriter_write(w, "}\n", 2);
+		}
+	}
+	if (!ndjson) xwriter_putc(w, '}');
+	return !w->error;
+}
+
+static size_t _xvec_elem_size(unsigned short type) {
+	switch (type) {
+		case CHAR: return sizeof(char);
+		case SHORT: return sizeof(short);
+		case USHORT: return sizeof(unsigned short);
+		case INT: return sizeof(int);
+		case UINT: return sizeof(unsigned int);
+		case LONG: return sizeof(long);
+		case ULONG: return sizeof(unsigned long);
+		case LONGLONG: return sizeof(long long);
+		case ULONGLONG: return sizeof(unsigned long long);
+		case FLOAT: return sizeof(float);
+		case DOUBLE: return sizeof(double);
+		case LONGDOUBLE: return sizeof(long double);
+	}
+	return 0;
+}
+
+/**
+ * Writes a numeric vector to path in the binary vector format.
+ * Returns 1 on success, 0 for other types or on any error.
+ */
+int vector_save(vector *v, const char *path) {
+	xvec_header header;
+	list_element *e;
+	xwriter w;
+	size_t size = _xvec_elem_size(v->type);
+	int fd, ok;
+
+	if (size == 0) return 0;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, XVEC_MAGIC, sizeof(header.magic));
+	header.version = XVEC_VERSION;
+	header.byte_order = 0x01020304;
+	header.type = v->type;
+	header.elem_size = (uint16_t)size;
+	header.count = v->list->size;
+	header.payload = XVEC_HEADER_SIZE;
+
+	if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) return 0;
+	xwriter_fd(&w, fd, 0);
+	xwriter_write(&w, (const char *)&header, sizeof(header));
+	for (e = v->list->head; e != NULL && !w.error; e = e->next) {
+		if (e->data == NULL) { w.error = 1; break; }
+		xwriter_write(&w, (const char *)e->data, size);
+	}
+	ok = xwriter_close(&w);
+	if (close(fd) != 0) ok = 0;
+	if (!ok) unlink(path);
+	return ok;
+}
+
+/**
+ * Maps a file written by vector_save() read-only; view->data points
+ * straight at the values. Returns 1 on success, 0 if the file cannot be
+ * mapped or is not a valid vector file for this machine.
+ */
+int vector_map_file(const char *path, vector_view *view) {
+	const xvec_header *header;
+	struct stat st;
+	void *map;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) == -1) return 0;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(xvec_header)) { close(fd); return 0; }
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) return 0;
+
+	header = (const xvec_header *)map;
+	if (memcmp(header->magic, XVEC_MAGIC, sizeof(header->magic)) != 0 || header->version != XVEC_VERSION
+			|| header->byte_order != 0x01020304 || header->elem_size == 0
+			|| header->elem_size != _xvec_elem_size(header->type) || header->payload < sizeof(xvec_header)
+			/* as vector_save() writes it, so the values are aligned for any type */
+			|| header->payload % XVEC_HEADER_SIZE != 0
+			|| header->payload > (uint64_t)st.st_size
+			|| header->count > ((uint64_t)st.st_size - header->payload) / header->elem_size) {
+		munmap(map, st.st_size);
+		return 0;
+	}
+	view->type = header->type;
+	view->elem_size = header->elem_size;
+	view->count = header->count;
+	view->data = (const char *)map + header->payload;
+	view->map = map;
+	view->map_len = st.st_size;
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	return 1;
+}
+
+void vector_unmap(vector_view *view) {
+	if (view->map != NULL) munmap(view->map, view->map_len);
+	view->map = NULL;
+	view->data = NULL;
+	view->count = 0;
+}
+
+/**
+ * Reads a file written by vector_save() into a new DYNAMIC vector, NULL on
+ * error. Use vector_map_file() to read large files without copying.
+ */
+vector *vector_load(const char *path) {
+	vector_view view;
+	vector *v;
+	const char *p;
+	void *data;
+	size_t i;
+
+	if (!vector_map_file(path, &view)) return NULL;
+	if ((v = vector_init(view.type, DYNAMIC)) != NULL) {
+		for (i = 0, p = (const char *)view.data; i < view.count; i++, p += view.elem_size) {
+			if ((data = malloc(view.elem_size)) == NULL) break;
+			memcpy(data, p, view.elem_size);
+			if (vector_push_back(v, data) == NULL) { free(data); break; }
+		}
+		if (i < view.count) vector_destroy(v);
+	}
+	vector_unmap(&view);
+	return v;
+}
@@ -0,0 +1,217 @@
+/********************************************************************
+ * Name: stats.c
+ * Author: rashaudteague
+ * License: GNU LGPL <http://www.gnu.org/licenses/>
+ * Description: Opt-in per-function counters and timers
+ ********************************************************************/
+
+#include "xstdlib.h"
+
+#ifdef XSTDLIB_STATS
+
+/*
+ * Every thread gets a cache line aligned slot of counters on its first
+ * instrumented call and is the only one to write it, so counting needs no
+ * atomic read-modify-write; stores are relaxed atomics only so a dump from
+ * another thread reads whole values. A thread's slot is kept when it exits
+ * and handed to the next new thread, so its counts are never lost.
+ */
+
+typedef struct __xstats_thread__ {
+	xstats_counter counters[XSTATS_COUNT];
+	struct __xstats_thread__ *next;
+	int in_use;
+} xstats_thread;
+
+static const struct {
+	const char *name;
+	int probed;
+} _xstats_functions[XSTATS_COUNT] = {
+	{ "split", 0 },
+	{ "strpos", 0 },
+	{ "str_replace", 0 },
+	{ "file", 0 },
+	{ "filesize", 0 },
+	{ "csv_feed", 0 },
+	{ "intern", 0 },
+	{ "hash_get", 1 },
+	{ "hash_get_many", 0 },
+	{ "hash_set", 0 },
+	{ "hash_unset", 1 },
+	{ "hash_cache_get", 0 },
+	{ "hash_cache_set", 0 },
+};
+
+static xstats_thread *_xstats_threads;
+static pthread_mutex_t _xstats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t _xstats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t _xstats_key;
+static unsigned long long _xstats_epoch_ticks;
+static long long _xstats_epoch_ns;
+
+static __thread xstats_thread *_xstats_local;
+static __thread xstats_scope *_xstats_current;
+
+static inline unsigned long long _xstats_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static long long _xstats_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void _xstats_release(void *slot) {
+	__atomic_store_n(&((xstats_thread *)slot)->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void _xstats_init(void) {
+	pthread_key_create(&_xstats_key, _xstats_release);
+	_xstats_epoch_ticks = _xstats_ticks();
+	_xstats_epoch_ns = _xstats_ns();
+}
+
+/**
+ * Gives the calling thread a slot, reusing one left by a finished thread
+ */
+static xstats_thread *_xstats_attach(void) {
+	xstats_thread *t;
+	void *p;
+
+	pthread_once(&_xstats_once, _xstats_init);
+	pthread_mutex_lock(&_xstats_lock);
+	for (t = _xstats_threads; t != NULL; t = t->next)
+		if (!__atomic_load_n(&t->in_use, __ATOMIC_ACQUIRE)) break;
+	if (t == NULL && posix_memalign(&p, 64, sizeof(xstats_thread)) == 0) {
+		t = (xstats_thread *)p;
+		memset(t, 0, sizeof(xstats_thread));
+		t->next = _xstats_threads;
+		_xstats_threads = t;
+	}
+	if (t != NULL) {
+		t->in_use = 1;
+		pthread_setspecific(_xstats_key, t);
+	}
+	pthread_mutex_unlock(&_xstats_lock);
+	return _xstats_local = t;
+}
+
+#define _xstats_add(field, n) __atomic_store_n(&(field), (field) + (n), __ATOMIC_RELAXED)
+
+void xstats_enter(xstats_scope *s, unsigned short id) {
+	s->outer = _xstats_current;
+	s->bytes = 0;
+	s->probes = 0;
+	s->id = id;
+	_xstats_current = s;
+	s->start = _xstats_ticks();
+}
+
+void xstats_leave(xstats_scope *s) {
+	unsigned long long ticks = _xstats_ticks() - s->start;
+	xstats_thread *t = _xstats_local;
+	xstats_counter *c;
+	unsigned int bucket;
+
+	_xstats_current = s->outer;
+	if (s->outer != NULL) s->outer->bytes += s->bytes;
+	if (t == NULL && (t = _xstats_attach()) == NULL) return;
+	c = &t->counters[s->id];
+	_xstats_add(c->calls, 1);
+	_xstats_add(c->ticks, ticks);
+	if (s->bytes > 0) _xstats_add(c->bytes, s->bytes);
+	if (_xstats_functions[s->id].probed) {
+		bucket = s->probes == 0 ? 0 : 32 - __builtin_clz(s->probes);
+		if (bucket >= XSTATS_PROBE_BUCKETS) bucket = XSTATS_PROBE_BUCKETS - 1;
+		_xstats_add(c->probes[bucket], 1);
+	}
+}
+
+/**
+ * Charges n allocated bytes to the innermost instrumented call, if any
+ */
+void xstats_bytes(size_t n) {
+	if (_xstats_current != NULL) _xstats_current->bytes += n;
+}
+
+/**
+ * Writes the counters of every thread, summed per function, as JSON.
+ * Times are inclusive of nested instrumented calls (hash_set() counts
+ * its hash_get() call) and converted to ns from the TSC rate measured since
+ * the first instrumented call. Returns 0 on a write error.
+ */
+int xstdlib_stats_dump(FILE *out) {
+	xstats_counter sum[XSTATS_COUNT];
+	const xstats_counter *c;
+	double ticks_per_ns = 1;
+	long long elapsed;
+	xstats_thread *t;
+	int i, j, threads = 0;
+
+	memset(sum, 0, sizeof(sum));
+	pthread_mutex_lock(&_xstats_lock);
+	for (t = _xstats_threads; t != NULL; t = t->next, threads++) {
+		for (i = 0; i < XSTATS_COUNT; i++) {
+			c = &t->counters[i];
+			sum[i].calls += __atomic_load_n(&c->calls, __ATOMIC_RELAXED);
+			sum[i].ticks += __atomic_load_n(&c->ticks, __ATOMIC_RELAXED);
+			sum[i].bytes += __atomic_load_n(&c->bytes, __ATOMIC_RELAXED);
+			for (j = 0; j < XSTATS_PROBE_BUCKETS; j++)
+				sum[i].probes[j] += __atomic_load_n(&c->probes[j], __ATOMIC_RELAXED);
+		}
+	}
+	pthread_mutex_unlock(&_xstats_lock);
+	if (threads > 0 && (elapsed = _xstats_ns() - _xstats_epoch_ns) > 0)
+		ticks_per_ns = (double)(_xstats_ticks() - _xstats_epoch_ticks) / elapsed;
+
+	fprintf(out, "{\n\"enabled\": true,\n\"threads\": %d,\n\"ticks_per_ns\": %.3f,\n\"functions\": [\n", threads, ticks_per_ns);
+	for (i = 0; i < XSTATS_COUNT; i++) {
+		fprintf(out, "%s  {\"name\": \"%s\", \"calls\": %llu, \"ticks\": %llu, \"ns\": %.0f, \"ns_per_call\": %.2f, \"bytes\": %llu",
+			i > 0 ? ",\n" : "", _xstats_functions[i].name, sum[i].calls, sum[i].ticks, sum[i].ticks / ticks_per_ns,
+			sum[i].calls > 0 ? sum[i].ticks / ticks_per_ns / sum[i].calls : 0.0, sum[i].bytes);
+		if (_xstats_functions[i].probed) {
+			fprintf(out, ", \"probes\": [");
+			for (j = 0; j < XSTATS_PROBE_BUCKETS; j++) fprintf(out, "%s%llu", j > 0 ? ", " : "", sum[i].probes[j]);
+			fprintf(out, "]");
+		}
+		fprintf(out, "}");
+	}
+	fprintf(out, "\n]\n}\n");
+	return !ferror(out);
+}
+
+/**
+ * Zeroes every thread's counters. Calls finishing at the same moment in
+ * other threads may still land in the old totals.
+ */
+void xstdlib_stats_reset(void) {
+	unsigned long long *field;
+	xstats_thread *t;
+	pthread_mutex_lock(&_xstats_lock);
+	for (t = _xstats_threads; t != NULL; t = t->next)
+		for (field = (unsigned long long *)t->counters; field < (unsigned long long *)(t->counters + XSTATS_COUNT); field++)
+			__atomic_store_n(field, 0, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&_xstats_lock);
+}
+
+#else
+
+/**
+ * Built without XSTDLIB_STATS: says so and returns 0
+ */
+int xstdlib_stats_dump(FILE *out) {
+	fprintf(out, "{\n\"enabled\": false\n}\n");
+	return 0;
+}
+
+void xstdlib_stats_reset(void) {
+}
+
+#endif
@@ -6,7 +6,17 @@
  * Description: Extension functions to the standard C Library
  *********************************************************************/
 
+/* emits the library copies of the header's inline fast paths */
+#define XSTDLIB_INLINE
 #include "xstdlib.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* ASCII-only case mapping, bytes of multibyte UTF-8 sequences pass through */
+#define _ascii_upper(c) ((c) >= 'a' && (c) <= 'z' ? (c) - ('a' - 'A') : (c))
+#define _ascii_lower(c) ((c) >= 'A' && (c) <= 'Z' ? (c) + ('a' - 'A') : (c))
+#define _utf8_continuation(c) (((unsigned char)(c) & 0xC0) == 0x80)
 
 char *escape(const char *s, char *buffer) {
 	size_t s_len = strlen(s);
@@ -22,15 +32,6 @@ char *escape(const char *s, char *buffer) {
 	return buffer;
 }
 
-/**
- * Checks whether a character is a valid ascii printable character codes 32-126
- * Returns true if the character is valid, false if not valid.
- */
-unsigned char is_ascii_pchar(char c) {
-	if (c >= 32 && c <= 126) return 1;
-	return 0;
-}
-
 /**
  * Converts an integer into a string
  */
@@ -84,39 +85,41 @@ char *rtrim(char *str) {
  * elements created or -1 if failed
  */
 int split(const char *delimiter, const char *s, char *elements[]) {
-	size_t s_len         = strlen(s);
-	size_t delimiter_len = strlen(delimiter);
-	int i = 0, e = 0, d, last_d = 0, c, x;
+	return split_a(NULL, delimiter, s, elements);
+}
+
+/**
+ * split() with the elements taken from allocator a (NULL for the default)
+ */
+int split_a(const xallocator *a, const char *delimiter, const char *s, char *elements[]) {
+	size_t delimiter_len = strlen(delimiter), x;
+	const char *start = s, *d;
+	int e = 0;
 	char *p;
 
-	if (delimiter_len > 0) {
-		while ((d = strpos(delimiter, s, i)) >= 0) {
-			c = (i == 0) ? c = 0 : last_d + delimiter_len;
-			if (d == 0) {
-				if ((p = (char *)malloc(sizeof(char))) == NULL) return e;
-				memcpy(p, "\0", 1);
-			} else {
-				x = d - c;
-				if ((p = (char *)malloc(x)) == NULL) return e;
-				memcpy(p, s + c, x);
-				p[x] = '\0';
-			}
-			last_d = d;
-			elements[e] = p;
-			i++, e++;
-		}
-		if ((p = (char *)malloc(s_len - c)) == NULL) return e;
-		memcpy(p, s + last_d + delimiter_len, s_len - c);
-		elements[e] = p;
-		e++;
+	XSTATS_SCOPE(XSTATS_SPLIT);
+	if (delimiter_len == 0) return 0;
+	for (;;) {
+		d = strstr(start, delimiter);
+		x = d != NULL ? (size_t)(d - start) : strlen(start);
+		if ((p = (char *)xalloc(a, x + 1)) == NULL) return e;
+		memcpy(p, start, x);
+		p[x] = '\0';
+		elements[e++] = p;
+		if (d == NULL) break;
+		start = d + delimiter_len;
 	}
 	return e;
 }
 
 void split_free(char *s[], int s_size) {
+	split_free_a(NULL, s, s_size);
+}
+
+void split_free_a(const xallocator *a, char *s[], int s_size) {
 	int i;
 	for (i = 0; i < s_size; i++) {
-		free(s[i]); s[i] = NULL;
+		xalloc_free(a, s[i]); s[i] = NULL;
 	}
 }
 
@@ -181,47 +184,41 @@ char *str_repeat(const char *str, int multiplier, char *buffer) {
  * @return pos, return -1 if the needle is not found
  */
 int strpos(const char *needle, const char *haystack, int offset) {
-	int pos = -1;
-	int haystack_size = strlen(haystack);
-	int needle_size = strlen(needle);
-	int i;
-	char *search;
-	if ((search = (char *) malloc(sizeof(char) * needle_size + 1)) == NULL) {
-		fprintf(stderr, "error in malloc in strpos\n");
-		exit(EXIT_FAILURE);
-	}
-	for (i = 0; i < haystack_size; i++) {
-		substr(haystack, search, i, needle_size);
-		
-		if (strcmp(search, needle) == 0) {
-			if (offset > 0) {
-				i = i + (needle_size - 1);
-				offset--;
-			} else {
-				free(search);
-				return i;
-			}
-		}
+	size_t needle_size = strlen(needle);
+	const char *p = haystack;
+
+	XSTATS_SCOPE(XSTATS_STRPOS);
+	if (needle_size == 0) return offset >= 0 && (size_t)offset < strlen(haystack) ? offset : -1;
+	/* offset skips that many earlier, non-overlapping matches */
+	while ((p = strstr(p, needle)) != NULL) {
+		if (offset-- <= 0) return (int)(p - haystack);
+		p += needle_size;
 	}
-	free(search);
-	return pos;
+	return -1;
 }
 
 /**
- * Replaces a sub string with string
+ * Replaces a sub string with string, appending the result to buffer
  */
 char *str_replace(const char *find, const char *replace, const char *source, char *buffer) {
-	int i = 0, p = 0, c = 0;
 	size_t find_len    = strlen(find);
 	size_t replace_len = strlen(replace);
-	size_t source_len  = strlen(source);
-	while ((c = strpos(find, source, i++)) >= 0) {
-		strncpy(buffer+strlen(buffer), source+p, c-p);
-		strncpy(buffer+strlen(buffer), replace, replace_len);
+	size_t len         = strlen(buffer);
+	const char *p = source, *c;
+	XSTATS_SCOPE(XSTATS_STR_REPLACE);
+	/* an empty find matches before every character */
+	while ((c = find_len > 0 ? strstr(p, find) : (*p != '\0' ? p : NULL)) != NULL) {
+		memcpy(buffer + len, p, c - p);
+		len += c - p;
+		memcpy(buffer + len, replace, replace_len);
+		len += replace_len;
 		p = c + find_len;
+		if (find_len == 0) buffer[len++] = *p++;
 	}
-	strncpy(buffer+strlen(buffer), source+p, source_len - p);
-	buffer[strlen(buffer)] = '\0';
+	c = p + strlen(p);
+	memcpy(buffer + len, p, c - p);
+	len += c - p;
+	buffer[len] = '\0';
 	return buffer;
 }
 
@@ -249,7 +246,7 @@ char *strrev(char *str) {
 char *strtoupper(char *str) {
 	size_t str_size = strlen(str);
 	size_t i = 0;
-	for ( ; i < str_size; i++) str[i] = toupper(str[i]);
+	for ( ; i < str_size; i++) str[i] = _ascii_upper(str[i]);
 	return str;
 }
 
@@ -259,7 +256,7 @@ char *strtoupper(char *str) {
 char *strtolower(char *str) {
 	size_t str_size = strlen(str);
 	size_t i = 0;
-	for ( ; i < str_size; i++) str[i] = tolower(str[i]);
+	for ( ; i < str_size; i++) str[i] = _ascii_lower(str[i]);
 	return str;
 }
 
@@ -294,10 +291,10 @@ char *swapcase(char *str) {
 	size_t str_size = strlen(str);
 	size_t i;
 	for (i = 0; i < str_size; i++) {
-		if (islower(str[i])) {
-			str[i] = toupper(str[i]);
-		} else if (isupper(str[i])) {
-			str[i] = tolower(str[i]);
+		if (str[i] >= 'a' && str[i] <= 'z') {
+			str[i] = _ascii_upper(str[i]);
+		} else if (str[i] >= 'A' && str[i] <= 'Z') {
+			str[i] = _ascii_lower(str[i]);
 		}
 	}
 	
@@ -318,7 +315,7 @@ char *trim(char *str) {
  * Turns the first letter in the string to uppercase
  */
 char *ucfirst(char *str) {
-	str[0] = toupper(str[0]);
+	str[0] = _ascii_upper(str[0]);
 	return str;
 }
 
@@ -329,8 +326,8 @@ char *ucwords(char *str) {
 	size_t str_size = strlen(str);
 	size_t i;
 	for (i = 0; i < str_size; i++) {
-		if (i == 0 || isspace(str[i-1])) {
-			str[i] = toupper(str[i]);
+		if (i == 0 || isspace((unsigned char)str[i-1])) {
+			str[i] = _ascii_upper(str[i]);
 		}
 	}
 	
@@ -351,10 +348,16 @@ char *wordwrap(const char *s, char *buffer, unsigned int line_limit, unsigned sh
 	size_t s_len = strlen(s);
 	int i = 0, j = 0, c = 0;
 	for ( ; i < s_len; i++, j++) {
+		/* columns count characters, continuation bytes stay with theirs */
+		if (_utf8_continuation(s[i])) { buffer[j] = s[i]; continue; }
 		if (c == line_limit) {
 			if (s[i] != ' ') {
-				if (!cut) while (s[i] != ' ') buffer[j++] = s[i++];
-				else { buffer[j++] = s[i]; if (s[i + 1] == ' ') i++; }
+				if (!cut) while (i < s_len && s[i] != ' ') buffer[j++] = s[i++];
+				else {
+					buffer[j++] = s[i];
+					while (_utf8_continuation(s[i + 1])) buffer[j++] = s[++i];
+					if (s[i + 1] == ' ') i++;
+				}
 				buffer[j] = '\n';
 			} else buffer[j] = '\n';
 			c = 0;
@@ -365,3 +368,91 @@ char *wordwrap(const char *s, char *buffer, unsigned int line_limit, unsigned sh
 	return buffer;
 }
 
+
+/**
+ * Returns the offset of the first byte in s that is not printable ASCII
+ * (32-126), or len if there is none. Checks 16 bytes at a time.
+ */
+size_t ascii_printable_span(const char *s, size_t len) {
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128i low = _mm_set1_epi8(31), high = _mm_set1_epi8(127);
+	__m128i x;
+	unsigned int bad;
+	/* as signed bytes 0x80-0xff are negative, so one range check covers them */
+	for (; i + 16 <= len; i += 16) {
+		x = _mm_loadu_si128((const __m128i *)(s + i));
+		bad = ~_mm_movemask_epi8(_mm_and_si128(_mm_cmpgt_epi8(x, low), _mm_cmplt_epi8(x, high))) & 0xFFFF;
+		if (bad != 0) return i + __builtin_ctz(bad);
+	}
+#endif
+	for (; i < len; i++)
+		if (s[i] < 32 || s[i] > 126) break;
+	return i;
+}
+
+/**
+ * Checks one multibyte sequence at s, returns its length or 0 if invalid
+ * (truncated, overlong, a surrogate or above U+10FFFF)
+ */
+static size_t _utf8_sequence(const unsigned char *s, size_t left) {
+	unsigned char c = s[0];
+	if (c >= 0xC2 && c <= 0xDF) {
+		if (left < 2 || !_utf8_continuation(s[1])) return 0;
+		return 2;
+	}
+	if (c >= 0xE0 && c <= 0xEF) {
+		if (left < 3 || !_utf8_continuation(s[1]) || !_utf8_continuation(s[2])) return 0;
+		if (c == 0xE0 && s[1] < 0xA0) return 0;
+		if (c == 0xED && s[1] > 0x9F) return 0;
+		return 3;
+	}
+	if (c >= 0xF0 && c <= 0xF4) {
+		if (left < 4 || !_utf8_continuation(s[1]) || !_utf8_continuation(s[2]) || !_utf8_continuation(s[3])) return 0;
+		if (c == 0xF0 && s[1] < 0x90) return 0;
+		if (c == 0xF4 && s[1] > 0x8F) return 0;
+		return 4;
+	}
+	return 0;
+}
+
+/**
+ * Returns 1 if s is well-formed UTF-8, otherwise 0 with the offset of the
+ * first bad sequence in error_at (when not NULL). ASCII runs are skipped
+ * 16 bytes at a time.
+ */
+int utf8_validate(const char *s, size_t len, size_t *error_at) {
+	const unsigned char *u = (const unsigned char *)s;
+	size_t i = 0, n;
+
+	while (i < len) {
+#ifdef __SSE2__
+		while (i + 16 <= len && _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(u + i))) == 0) i += 16;
+		if (i >= len) break;
+#endif
+		if (u[i] < 0x80) { i++; continue; }
+		if ((n = _utf8_sequence(u + i, len - i)) == 0) {
+			if (error_at != NULL) *error_at = i;
+			return 0;
+		}
+		i += n;
+	}
+	return 1;
+}
+
+/**
+ * Counts the code points in valid UTF-8, i.e. every byte that is not a
+ * continuation byte
+ */
+size_t utf8_count_codepoints(const char *s, size_t len) {
+	size_t i = 0, continuations = 0;
+#ifdef __SSE2__
+	const __m128i limit = _mm_set1_epi8(-64);
+	/* continuation bytes 0x80-0xbf are the signed bytes below -64 */
+	for (; i + 16 <= len; i += 16)
+		continuations += __builtin_popcount(_mm_movemask_epi8(_mm_cmplt_epi8(_mm_loadu_si128((const __m128i *)(s + i)), limit)));
+#endif
+	for (; i < len; i++)
+		continuations += _utf8_continuation(s[i]);
+	return len - continuations;
+}
@@ -9,10 +9,256 @@
 #include "xstdlib.h"
 
 vector *vector_init(unsigned short type, unsigned short memory_type) {
+	return vector_init_a(NULL, type, memory_type);
+}
+
+vector *vector_init_a(const xallocator *a, unsigned short type, unsigned short memory_type) {
 	vector *v = NULL;
-	if ((v = (vector *)malloc(sizeof(vector))) == NULL) return NULL;
-	if ((v->list = list_init()) == NULL) return NULL;
+	if ((v = (vector *)xalloc(a, sizeof(vector))) == NULL) return NULL;
+	if ((v->list = list_init_a(a)) == NULL) { xalloc_free(a, v); return NULL; }
 	v->type = type;
 	v->memory_type = memory_type;
 	return v;
 }
+
+/*
+ * The parallel operations snapshot the list into an array of elements and
+ * cut it into chunks. The calling thread and up to one task per pool worker
+ * claim chunks until none are left, so a busy pool never stalls the caller.
+ */
+
+typedef struct __vector_job__ {
+	vector_element **elements;
+	size_t count;
+	size_t chunk;          /* elements per chunk */
+	size_t nchunks;
+	size_t next;           /* next chunk to claim */
+	size_t finished;       /* chunks done */
+	unsigned long refs;    /* the caller plus every submitted task */
+	pthread_mutex_t lock;
+	pthread_cond_t done;
+	void (*run)(struct __vector_job__ *job, size_t begin, size_t end, size_t chunk);
+	unsigned short type;
+	unsigned short op;
+	long double (*map)(long double x, void *arg);
+	void (*each)(vector_element *e, void *arg);
+	int (*keep)(vector_element *e, void *arg);
+	void *arg;
+	long double *partials; /* one per chunk for vector_reduce() */
+	unsigned char *flags;  /* one per element for vector_filter() */
+} _vector_job;
+
+#define _VECTOR_NUMERIC_TYPES(X) \
+	X(CHAR, char) X(SHORT, short) X(USHORT, unsigned short) X(INT, int) X(UINT, unsigned int) \
+	X(LONG, long) X(ULONG, unsigned long) X(LONGLONG, long long) X(ULONGLONG, unsigned long long) \
+	X(FLOAT, float) X(DOUBLE, double) X(LONGDOUBLE, long double)
+
+static int _vector_is_numeric(unsigned short type) {
+	return type >= CHAR && type <= LONGDOUBLE && type != STRING;
+}
+
+static _vector_job *_vector_job_init(vector *v, void (*run)(_vector_job *, size_t, size_t, size_t)) {
+	_vector_job *job;
+	vector_element *e;
+	size_t i = 0;
+
+	if ((job = (_vector_job *)calloc(1, sizeof(_vector_job))) == NULL) return NULL;
+	job->count = v->list->size;
+	if ((job->elements = (vector_element **)malloc((job->count + 1) * sizeof(vector_element *))) == NULL) {
+		free(job);
+		return NULL;
+	}
+	for (e = v->list->head; e != NULL && i < job->count; e = e->next) job->elements[i++] = e;
+	job->count = i;
+	job->run = run;
+	job->type = v->type;
+	job->refs = 1;
+	pthread_mutex_init(&job->lock, NULL);
+	pthread_cond_init(&job->done, NULL);
+	return job;
+}
+
+static void _vector_job_release(_vector_job *job) {
+	if (__atomic_sub_fetch(&job->refs, 1, __ATOMIC_ACQ_REL) != 0) return;
+	pthread_mutex_destroy(&job->lock);
+	pthread_cond_destroy(&job->done);
+	free(job->elements);
+	free(job->partials);
+	free(job->flags);
+	free(job);
+}
+
+static void _vector_job_work(_vector_job *job) {
+	size_t c, begin, end;
+	while ((c = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->nchunks) {
+		begin = c * job->chunk;
+		end = begin + job->chunk < job->count ? begin + job->chunk : job->count;
+		job->run(job, begin, end, c);
+		if (__atomic_add_fetch(&job->finished, 1, __ATOMIC_ACQ_REL) == job->nchunks) {
+			pthread_mutex_lock(&job->lock);
+			pthread_cond_broadcast(&job->done);
+			pthread_mutex_unlock(&job->lock);
+		}
+	}
+}
+
+static void _vector_job_task(void *arg) {
+	_vector_job *job = (_vector_job *)arg;
+	_vector_job_work(job);
+	_vector_job_release(job);
+}
+
+/**
+ * Sizes the chunks (allocating the per-chunk partials if asked) and runs
+ * the job to completion. Returns 0 if out of memory.
+ */
+static int _vector_job_run(_vector_job *job, int partials) {
+	xpool *pool = job->count >= 2 * VECTOR_PARALLEL_CHUNK ? xpool_default() : NULL;
+	size_t workers = pool != NULL ? pool->nthreads : 0, tasks, i;
+
+	job->nchunks = job->count / VECTOR_PARALLEL_CHUNK;
+	if (job->nchunks > (workers + 1) * 4) job->nchunks = (workers + 1) * 4;
+	if (job->nchunks == 0) job->nchunks = job->count > 0;
+	job->chunk = job->nchunks > 0 ? (job->count + job->nchunks - 1) / job->nchunks : 0;
+	if (partials && job->nchunks > 0 && (job->partials = (long double *)malloc(job->nchunks * sizeof(long double))) == NULL)
+		return 0;
+
+	tasks = job->nchunks > 1 ? job->nchunks - 1 : 0;
+	if (tasks > workers) tasks = workers;
+	for (i = 0; i < tasks; i++) {
+		__atomic_add_fetch(&job->refs, 1, __ATOMIC_ACQ_REL);
+		if (!xpool_submit(pool, _vector_job_task, job)) { __atomic_sub_fetch(&job->refs, 1, __ATOMIC_ACQ_REL); break; }
+	}
+
+	_vector_job_work(job);
+	pthread_mutex_lock(&job->lock);
+	while (__atomic_load_n(&job->finished, __ATOMIC_ACQUIRE) < job->nchunks)
+		pthread_cond_wait(&job->done, &job->lock);
+	pthread_mutex_unlock(&job->lock);
+	return 1;
+}
+
+static void _vector_map_run(_vector_job *job, size_t begin, size_t end, size_t chunk) {
+	vector_element **e = job->elements;
+	size_t i;
+	switch (job->type) {
+#define _VECTOR_MAP(type, T) \
+		case type: \
+			for (i = begin; i < end; i++) *(T *)e[i]->data = (T)job->map((long double)*(T *)e[i]->data, job->arg); \
+			break;
+		_VECTOR_NUMERIC_TYPES(_VECTOR_MAP)
+#undef _VECTOR_MAP
+	}
+}
+
+static void _vector_reduce_run(_vector_job *job, size_t begin, size_t end, size_t chunk) {
+	vector_element **e = job->elements;
+	long double acc = 0;
+	size_t i;
+	switch (job->type) {
+#define _VECTOR_REDUCE(type, T) \
+		case type: \
+			acc = *(T *)e[begin]->data; \
+			switch (job->op) { \
+				case VECTOR_SUM: for (i = begin + 1; i < end; i++) acc += *(T *)e[i]->data; break; \
+				case VECTOR_MIN: for (i = begin + 1; i < end; i++) if (*(T *)e[i]->data < acc) acc = *(T *)e[i]->data; break; \
+				case VECTOR_MAX: for (i = begin + 1; i < end; i++) if (*(T *)e[i]->data > acc) acc = *(T *)e[i]->data; break; \
+			} \
+			break;
+		_VECTOR_NUMERIC_TYPES(_VECTOR_REDUCE)
+#undef _VECTOR_REDUCE
+	}
+	job->partials[chunk] = acc;
+}
+
+static void _vector_foreach_run(_vector_job *job, size_t begin, size_t end, size_t chunk) {
+	size_t i;
+	for (i = begin; i < end; i++) job->each(job->elements[i], job->arg);
+}
+
+static void _vector_filter_run(_vector_job *job, size_t begin, size_t end, size_t chunk) {
+	size_t i;
+	for (i = begin; i < end; i++) job->flags[i] = job->keep(job->elements[i], job->arg) != 0;
+}
+
+/**
+ * Replaces every element of a numeric vector with fn(element) in parallel.
+ * Returns 1 on success, 0 for a non-numeric vector or when out of memory.
+ */
+int vector_map(vector *v, long double (*fn)(long double x, void *arg), void *arg) {
+	_vector_job *job;
+	int rc;
+	if (!_vector_is_numeric(v->type)) return 0;
+	if ((job = _vector_job_init(v, _vector_map_run)) == NULL) return 0;
+	job->map = fn;
+	job->arg = arg;
+	rc = _vector_job_run(job, 0);
+	_vector_job_release(job);
+	return rc;
+}
+
+/**
+ * Sums (VECTOR_SUM) or finds the smallest/largest element (VECTOR_MIN,
+ * VECTOR_MAX) of a numeric vector in parallel. Partial results are combined
+ * in element order, so a floating point sum does not depend on scheduling.
+ * Returns 1 and sets result, or 0 if the vector is empty or not numeric.
+ */
+int vector_reduce(vector *v, unsigned short op, long double *result) {
+	_vector_job *job;
+	long double acc;
+	size_t c;
+	int rc;
+
+	if (!_vector_is_numeric(v->type) || op < VECTOR_SUM || op > VECTOR_MAX || v->list->size == 0) return 0;
+	if ((job = _vector_job_init(v, _vector_reduce_run)) == NULL) return 0;
+	job->op = op;
+	if ((rc = _vector_job_run(job, 1))) {
+		acc = job->partials[0];
+		for (c = 1; c < job->nchunks; c++) {
+			if (op == VECTOR_SUM) acc += job->partials[c];
+			else if (op == VECTOR_MIN ? job->partials[c] < acc : job->partials[c] > acc) acc = job->partials[c];
+		}
+		*result = acc;
+	}
+	_vector_job_release(job);
+	return rc;
+}
+
+/**
+ * Calls fn on every element of any vector in parallel, in no particular
+ * order. Returns 1 on success or 0 when out of memory.
+ */
+int vector_foreach_parallel(vector *v, void (*fn)(vector_element *e, void *arg), void *arg) {
+	_vector_job *job;
+	int rc;
+	if ((job = _vector_job_init(v, _vector_foreach_run)) == NULL) return 0;
+	job->each = fn;
+	job->arg = arg;
+	rc = _vector_job_run(job, 0);
+	_vector_job_release(job);
+	return rc;
+}
+
+/**
+ * Returns a new vector, in the original order, of the elements keep()
+ * accepts; keep() runs in parallel. The new vector shares the data and is
+ * NONDYNAMIC, so destroying it leaves v intact. NULL when out of memory.
+ */
+vector *vector_filter(vector *v, int (*keep)(vector_element *e, void *arg), void *arg) {
+	_vector_job *job;
+	vector *out = NULL;
+	size_t i;
+
+	if ((job = _vector_job_init(v, _vector_filter_run)) == NULL) return NULL;
+	job->keep = keep;
+	job->arg = arg;
+	if ((job->flags = (unsigned char *)malloc(job->count + 1)) != NULL && _vector_job_run(job, 0)
+			&& (out = vector_init_a(v->list->allocator, v->type, NONDYNAMIC)) != NULL) {
+		for (i = 0; i < job->count; i++) {
+			if (!job->flags[i]) continue;
+			if (vector_push_back(out, job->elements[i]->data) == NULL) { vector_destroy(out); break; }
+		}
+	}
+	_vector_job_release(job);
+	return out;
+}
@@ -15,16 +15,30 @@ extern "C" {
 
 #include <unistd.h>
 #include <sys/fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <float.h>
 #include <math.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <time.h>
 #include <limits.h>
 #include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 
 #define XSTDLIB_VERSION 190
 
@@ -42,31 +56,224 @@ extern "C" {
         #define BIT_SIZE 32
 #endif
 
+/* allocators */
+typedef struct __xallocator__ {
+	void *(*alloc)(size_t size, void *ctx);
+	void *(*resize)(void *p, size_t old_size, size_t new_size, void *ctx);
+	void (*release)(void *p, void *ctx);
+	void *ctx;
+} xallocator;
+
+void xstdlib_set_allocator(const xallocator *a);
+void *xalloc(const xallocator *a, size_t size);
+void *xalloc_zero(const xallocator *a, size_t n, size_t size);
+void *xalloc_resize(const xallocator *a, void *p, size_t old_size, size_t new_size);
+void xalloc_free(const xallocator *a, void *p);
+
+/* bump-pointer arena, freed all at once or back to a mark */
+#define ARENA_BLOCK_SIZE (64 * KB)
+
+typedef struct __arena_block__ {
+	struct __arena_block__ *prev;
+	size_t size;
+	size_t used;
+} arena_block;
+
+typedef struct __arena__ {
+	arena_block *head;
+	size_t block_size;
+	xallocator allocator;
+} arena;
+
+typedef struct __arena_mark__ {
+	arena_block *block;
+	size_t used;
+} arena_mark;
+
+arena *arena_init(size_t block_size);
+void *arena_alloc(arena *a, size_t size);
+arena_mark arena_get_mark(arena *a);
+void arena_reset(arena *a, const arena_mark *mark);
+void arena_destroy(arena *a);
+#define arena_allocator(a) (&(a)->allocator)
+
+/*
+ * Per-function call counts, TSC time, allocated bytes and hash probe
+ * lengths, compiled into the library only with -DXSTDLIB_STATS (make
+ * stats). Each thread counts into its own slot and xstdlib_stats_dump()
+ * adds the slots up. Without the flag the XSTATS_ macros expand to nothing.
+ */
+enum xstats_functions {
+	XSTATS_SPLIT,
+	XSTATS_STRPOS,
+	XSTATS_STR_REPLACE,
+	XSTATS_FILE,
+	XSTATS_FILESIZE,
+	XSTATS_CSV_FEED,
+	XSTATS_INTERN,
+	XSTATS_HASH_GET,
+	XSTATS_HASH_GET_MANY,
+	XSTATS_HASH_SET,
+	XSTATS_HASH_UNSET,
+	XSTATS_HASH_CACHE_GET,
+	XSTATS_HASH_CACHE_SET,
+	XSTATS_COUNT
+};
+
+/* entries compared per lookup: 0, 1, 2-3, 4-7, ..., 64 and up */
+#define XSTATS_PROBE_BUCKETS 8
+
+typedef struct __xstats_counter__ {
+	unsigned long long calls;
+	unsigned long long ticks;      /* including nested instrumented calls */
+	unsigned long long bytes;      /* allocated, likewise */
+	unsigned long long probes[XSTATS_PROBE_BUCKETS];
+} xstats_counter;
+
+int xstdlib_stats_dump(FILE *out);
+void xstdlib_stats_reset(void);
+
+#ifdef XSTDLIB_STATS
+typedef struct __xstats_scope__ {
+	struct __xstats_scope__ *outer;
+	unsigned long long start;
+	unsigned long long bytes;
+	unsigned int probes;
+	unsigned short id;
+} xstats_scope;
+
+void xstats_enter(xstats_scope *s, unsigned short id);
+void xstats_leave(xstats_scope *s);
+void xstats_bytes(size_t n);
+
+/* counts the rest of the enclosing block, however it is left */
+#define XSTATS_SCOPE(id) \
+	xstats_scope _xstats __attribute__((__cleanup__(xstats_leave))); \
+	xstats_enter(&_xstats, id)
+#define XSTATS_PROBE() (_xstats.probes++)
+#define XSTATS_BYTES(n) xstats_bytes(n)
+#else
+#define XSTATS_SCOPE(id) ((void)0)
+#define XSTATS_PROBE() ((void)0)
+#define XSTATS_BYTES(n) ((void)0)
+#endif
+
 #define random(low, high) (low + rand() % ((high + 1) - low))
 #define foreach(element, as, count) \
 			as = element; unsigned int _fori = 0; \
 			for (_fori = 0; _fori < count; _fori++, as++)
 
 int bin2dec(const char *bin);
+unsigned long long bin2dec_u64(const char *bin);
+size_t bin2dec_array(const char *in, size_t count, unsigned int width, unsigned long long *out);
 int ctoi(unsigned char c);
 char *dec2bin(int dec, char *buffer);
+char *dec2bin_u64(unsigned long long dec, char *buffer);
+size_t dec2bin_array(const unsigned long long *in, size_t count, unsigned int width, char *out);
 void dec2frac(float decimal, float *le_fraction);
 char *dec2hex(int dec, char *buffer);
+char *dec2hex_u64(unsigned long long dec, char *buffer);
+size_t dec2hex_array(const unsigned long long *in, size_t count, unsigned int width, char *out);
 int fact(int n);
 int hex2dec(char *hex);
+unsigned long long hex2dec_u64(const char *hex);
+size_t hex2dec_array(const char *in, size_t count, unsigned int width, unsigned long long *out);
 void reduce_frac(float *le_fraction, float *reduce);
 float xround(const float n, int precision);
 
+enum xround_modes {
+	XROUND_HALF_UP,   /* floor(n + 0.5), what xround() does */
+	XROUND_HALF_EVEN,
+	XROUND_TRUNC,
+};
+double xround_d(const double n, int precision, unsigned short mode);
+void xround_array(float *a, size_t count, int precision, unsigned short mode);
+void xround_array_d(double *a, size_t count, int precision, unsigned short mode);
+
+/* exact rationals, always kept reduced with a positive denominator */
+#define RATIONAL_MAX_DEN 1000000000LL
+
+typedef struct __rational__ {
+	long long num;
+	long long den;
+} rational;
+
+unsigned long long gcd(unsigned long long a, unsigned long long b);
+int rational_init(rational *r, long long num, long long den);
+int rational_reduce(rational *r);
+size_t rational_reduce_array(rational *r, size_t count);
+int rational_add(rational *r, const rational *a, const rational *b);
+int rational_sub(rational *r, const rational *a, const rational *b);
+int rational_mul(rational *r, const rational *a, const rational *b);
+int rational_div(rational *r, const rational *a, const rational *b);
+int rational_cmp(const rational *a, const rational *b);
+int rational_from_double(rational *r, double x, long long max_den);
+double rational_to_double(const rational *r);
+
 /* file operation prototypes */
 char *basename(const char *path, char *buffer);
 int copy(const char *source, const char *dest);
 long long fappend(const char *path, char *data);
 int file(const char *filename, char *elements[], unsigned char flags);
+int file_a(const xallocator *a, const char *filename, char *elements[], unsigned char flags);
 int file_exists(const char *name);
 long long file_get_contents(const char *filename, char *buffer, int maxlen);
 long long filesize(const char *path);
 int move(char *source, char *dest);
 long long readfile(const char *path, FILE *des);
+
+/* streaming line reader */
+#define LINE_READER_BUFSIZE MB
+
+typedef struct __line_reader__ {
+	int fd;
+	int owns_fd;
+	char *buf;
+	size_t size;    /* capacity of buf, only grows for lines longer than it */
+	size_t start;   /* first byte of the next line */
+	size_t scan;    /* where the newline search resumes */
+	size_t end;     /* one past the last byte read */
+	int eof;
+	int newline;    /* whether the last line returned ended with '\n' */
+} line_reader;
+
+line_reader *line_reader_open(const char *path, size_t bufsize);
+line_reader *line_reader_fdopen(int fd, size_t bufsize);
+int line_reader_next(line_reader *r, const char **line, size_t *len);
+void line_reader_close(line_reader *r);
+long long file_foreach_line(const char *path, int (*callback)(const char *line, size_t len, void *arg), void *arg);
+
+/* directory sizes kept current from inotify events */
+#ifdef __linux__
+typedef struct __dirsize_node__ {
+	struct __dirsize_node__ *parent;
+	struct __dirsize_node__ *children;
+	struct __dirsize_node__ *sibling;
+	struct __dirsize_node__ *next_dirty;
+	int wd;                /* inotify watch, -1 if none */
+	int dirty;             /* needs its entries read again */
+	long long own;         /* st_size of the direct entries */
+	long long total;       /* own plus every subdirectory's total */
+	char name[];           /* the full path for the root */
+} dirsize_node;
+
+typedef struct __dirsize__ {
+	char path[PATH_MAX];
+	int fd;
+	dirsize_node *root;
+	dirsize_node **by_wd;
+	size_t by_wd_size;
+	dirsize_node *dirty;
+	unsigned long long events;
+	unsigned long long rescans;
+} dirsize;
+
+dirsize *dirsize_open(const char *path);
+int dirsize_update(dirsize *d);
+long long dirsize_get(dirsize *d, const char *path);
+int dirsize_fd(const dirsize *d);
+void dirsize_close(dirsize *d);
+#endif
 /* end */
 
 
@@ -76,6 +283,7 @@ enum str_pad_types {
 	STR_PAD_RIGHT,
 	STR_PAD_BOTH,
 };
+size_t ascii_printable_span(const char *s, size_t len);
 char *escape(const char *s, char *buffer);
 unsigned char is_ascii_pchar(char c);
 char *itoa(long i, char *buffer);
@@ -83,7 +291,9 @@ char *join(const char *glue, char *elements[], int element_count, char *buffer);
 char *ltrim(char *str);
 char *rtrim(char *str);
 int split(const char *delimiter, const char *str, char *elements[]);
+int split_a(const xallocator *a, const char *delimiter, const char *str, char *elements[]);
 void split_free(char *s[], int s_size);
+void split_free_a(const xallocator *a, char *s[], int s_size);
 char *str_concave(const char *str, char *buffer, int size_limit);
 char *str_pad(const char *str, char *buffer, unsigned int pad_length, const char *pad_str, unsigned short pad_type);
 int strpos(const char *needle, const char *haystack, int offset);
@@ -99,15 +309,248 @@ char *ucfirst(char *str);
 char *ucwords(char *str);
 char *unescape(char *s);
 char *wordwrap(const char *s, char *buffer, unsigned int line_limit, unsigned short cut);
+int utf8_validate(const char *s, size_t len, size_t *error_at);
+size_t utf8_count_codepoints(const char *s, size_t len);
 /* end */
 
 #define file_free split_free
+#define file_free_a split_free_a
 
 /* os */
+enum shell_stderr_modes {
+	SHELL_STDERR_INHERIT,
+	SHELL_STDERR_CAPTURE,
+	SHELL_STDERR_MERGE,
+};
+
+enum shell_streams {
+	SHELL_STDOUT = 1,
+	SHELL_STDERR,
+};
+
+typedef struct __shell_opts__ {
+	unsigned short stderr_mode;
+	long timeout_ms;       /* kill the command after this long, 0 for no limit */
+	size_t max_output;     /* bytes kept per captured stream, 0 for no limit */
+	// when set, output is streamed here instead of being buffered, a
+	// nonzero return kills the command
+	int (*on_output)(unsigned short stream, const char *data, size_t len, void *arg);
+	void *arg;
+} shell_opts;
+
+typedef struct __shell_result__ {
+	char *out;
+	size_t out_len;
+	char *err;
+	size_t err_len;
+	int status;            /* exit code, 128 + signal if killed, -1 if it could not run */
+	unsigned char timed_out;
+	unsigned char truncated;
+} shell_result;
+
 char * shell_exec(const char *command, char *out);
+int shell_run(const char *command, const shell_opts *opts, shell_result *result);
+int shell_exec_many(const char *commands[], int count, int parallelism, const shell_opts *opts, shell_result results[]);
+void shell_result_free(shell_result *result);
 
 /* io */
+enum xlog_levels {
+	XLOG_DEBUG,
+	XLOG_INFO,
+	XLOG_WARN,
+	XLOG_ERROR,
+	XLOG_FATAL,
+};
+
+enum xlog_policies {
+	XLOG_DROP,  /* discard the record when the calling thread's ring is full */
+	XLOG_BLOCK, /* wait for the writer thread to make room */
+};
+
+#define XLOG_RING_SIZE 1024
+#define XLOG_MAX_ARGS 16
+#define XLOG_TEXT_SIZE 192
+
 void die(const char *format, ...);
+int xlog_init(int fd, unsigned short level, unsigned int ring_size, unsigned short policy);
+void xlog(unsigned short level, const char *format, ...);
+void xlog_flush(void);
+void xlog_shutdown(void);
+unsigned long long xlog_dropped(void);
+
+/* pool */
+#define XPOOL_QUEUE_SIZE 256
+
+typedef struct __xpool_task__ {
+	void (*fn)(void *arg);
+	void *arg;
+} xpool_task;
+
+typedef struct __xpool_queue__ {
+	pthread_mutex_t lock;
+	xpool_task *tasks;     /* ring, the owner works at the tail and thieves at the head */
+	size_t head;
+	size_t size;
+	size_t cap;
+	struct __xpool__ *pool;
+} xpool_queue;
+
+typedef struct __xpool__ {
+	pthread_t *threads;
+	xpool_queue *queues;   /* one per worker */
+	int nthreads;
+	int stop;
+	unsigned long next;    /* round-robin queue for tasks submitted from outside */
+	unsigned long pending; /* submitted and not yet finished */
+	unsigned long queued;  /* sitting in a queue */
+	unsigned long sleeping;
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t done;
+} xpool;
+
+xpool *xpool_init(int threads);
+int xpool_submit(xpool *p, void (*fn)(void *arg), void *arg);
+void xpool_wait(xpool *p);
+void xpool_destroy(xpool *p);
+xpool *xpool_default(void);
+
+/* bounded lock-free queues */
+#define XQUEUE_CACHE_LINE 64
+#define _xqueue_aligned __attribute__((__aligned__(XQUEUE_CACHE_LINE)))
+
+typedef struct __spsc_queue__ {
+	void **items;
+	size_t mask;
+	size_t head _xqueue_aligned;   /* next slot to pop, written by the consumer */
+	size_t tail_cache;             /* the consumer's last look at tail */
+	size_t tail _xqueue_aligned;   /* next slot to push, written by the producer */
+	size_t head_cache;             /* the producer's last look at head */
+} spsc_queue;
+
+typedef struct __mpmc_cell__ {
+	size_t seq;
+	void *data;
+} mpmc_cell;
+
+typedef struct __mpmc_queue__ {
+	mpmc_cell *cells;
+	size_t mask;
+	size_t enqueue_pos _xqueue_aligned;
+	size_t dequeue_pos _xqueue_aligned;
+} mpmc_queue;
+
+spsc_queue *spsc_init(size_t capacity);
+int spsc_push(spsc_queue *q, void *item);
+int spsc_pop(spsc_queue *q, void **item);
+size_t spsc_push_n(spsc_queue *q, void *const *items, size_t n);
+size_t spsc_pop_n(spsc_queue *q, void **items, size_t n);
+void spsc_push_wait(spsc_queue *q, void *item);
+void *spsc_pop_wait(spsc_queue *q);
+void spsc_destroy(spsc_queue *q);
+mpmc_queue *mpmc_init(size_t capacity);
+int mpmc_push(mpmc_queue *q, void *item);
+int mpmc_pop(mpmc_queue *q, void **item);
+size_t mpmc_push_n(mpmc_queue *q, void *const *items, size_t n);
+size_t mpmc_pop_n(mpmc_queue *q, void **items, size_t n);
+void mpmc_push_wait(mpmc_queue *q, void *item);
+void *mpmc_pop_wait(mpmc_queue *q);
+void mpmc_destroy(mpmc_queue *q);
+
+/* rope */
+#define ROPE_CHUNK 1024
+
+typedef struct __rope_node__ {
+	struct __rope_node__ *left;
+	struct __rope_node__ *right;
+	size_t size;           /* bytes in this subtree */
+	size_t len;            /* bytes in data */
+	unsigned int priority;
+	char data[ROPE_CHUNK];
+} rope_node;
+
+typedef struct __rope__ {
+	rope_node *root;
+	unsigned int seed;
+	const xallocator *allocator; /* nodes, NULL for the default */
+} rope;
+
+rope *rope_init(const char *s);
+rope *rope_init_n(const char *s, size_t len);
+rope *rope_init_a(const xallocator *a, const char *s);
+rope *rope_init_n_a(const xallocator *a, const char *s, size_t len);
+size_t rope_length(const rope *r);
+int rope_insert(rope *r, size_t pos, const char *s, size_t len);
+int rope_delete(rope *r, size_t pos, size_t len);
+void rope_concat(rope *r, rope *other);
+char *rope_substr(const rope *r, size_t pos, size_t len, char *buffer);
+char *rope_flatten(const rope *r, char *buffer);
+long rope_strpos(const rope *r, const char *needle, int offset);
+long rope_replace(rope *r, const char *find, const char *replace);
+void rope_toupper(rope *r);
+void rope_tolower(rope *r);
+void rope_destroy(rope *r);
+
+/* csv */
+#define CSV_BUFSIZE MB
+
+typedef struct __csv_field__ {
+	const char *data;  /* not NUL terminated, quotes and escapes removed */
+	size_t len;
+	int quoted;
+} csv_field;
+
+typedef int (*csv_callback)(const csv_field *fields, size_t count, void *arg);
+
+typedef struct __csv_parser__ {
+	char delimiter;
+	char quote;
+	char escape;
+	csv_callback callback;
+	void *arg;
+	csv_field *fields;
+	size_t count;          /* fields in the current record */
+	size_t fields_size;
+	char *carry;           /* a record cut off by the end of a chunk */
+	size_t carry_len;
+	size_t carry_size;
+	int carry_quoted;
+	int carry_escaped;
+	char *scratch;         /* unescaped copies of fields */
+	size_t scratch_size;
+	long long records;
+	int status;            /* 1 once stopped by the callback, -1 out of memory */
+} csv_parser;
+
+csv_parser *csv_init(char delimiter, char quote, char escape, csv_callback callback, void *arg);
+int csv_feed(csv_parser *p, const char *data, size_t len);
+int csv_finish(csv_parser *p);
+void csv_destroy(csv_parser *p);
+long long csv_foreach_record(const char *path, char delimiter, char quote, char escape, csv_callback callback, void *arg);
+
+/* intern */
+#define INTERN_BLOCK_SIZE (64 * KB)
+
+typedef struct __intern_slot__ {
+	const char *str;
+	uint32_t hash;
+	uint32_t len;
+} intern_slot;
+
+typedef struct __intern_pool__ {
+	arena *strings;        /* the canonical copies, never moved */
+	intern_slot *slots;    /* open addressed, a power of two */
+	size_t size;
+	size_t cap;
+	size_t bytes;          /* string bytes held, terminators included */
+} intern_pool;
+
+intern_pool *intern_init(size_t capacity);
+const char *intern(intern_pool *p, const char *s);
+const char *intern_n(intern_pool *p, const char *s, size_t len);
+const char *intern_lookup(intern_pool *p, const char *s);
+void intern_destroy(intern_pool *p);
+int split_intern(intern_pool *p, const char *delimiter, const char *str, const char *elements[]);
 
 /* lists */
 enum __types__ {
@@ -150,9 +593,11 @@ typedef struct __list__ {
 	list_element *tail;
 	list_element *current; /* the current iteration position of this vector */
 	list_element *next; /* next element from current */
+	const xallocator *allocator; /* elements, NULL for the default */
 } list;
 
 list *list_init(void);
+list *list_init_a(const xallocator *a);
 list_element *list_element_init(list *l, void *data, unsigned short type, unsigned short memory_type);
 list_element *list_insert_before(list *l, list_element *before, void *data, unsigned int type, unsigned short memory_type);
 list_element *list_insert_after(list *l, list_element *after, void *data, unsigned int type, unsigned short memory_type);
@@ -170,6 +615,61 @@ void list_fill(list *l, unsigned int qty, long double value);
 void list_random_fill(list *l, unsigned int qty);
 void list_swap(list *l, list_element *a, list_element *b);
 
+/* deque, a ring buffer with O(1) push and pop at both ends */
+#define DEQUE_MIN_CAPACITY 16
+
+typedef struct __deque_slot__ {
+	void *data;
+	unsigned short type;
+	unsigned short memory_type;
+} deque_slot;
+
+typedef struct __deque__ {
+	deque_slot *slots;
+	size_t head;
+	size_t size;
+	size_t cap;                  /* always a power of two */
+	void (*destroy)(void *d);    /* frees data instead of memory_type when set */
+	const xallocator *allocator;
+} deque;
+
+#define deque_size(d) ((d)->size)
+deque *deque_init(size_t capacity);
+deque *deque_init_a(const xallocator *a, size_t capacity);
+int deque_push_back(deque *d, void *data, unsigned short type, unsigned short memory_type);
+int deque_push_front(deque *d, void *data, unsigned short type, unsigned short memory_type);
+void *deque_pop_back(deque *d);
+void *deque_pop_front(deque *d);
+deque_slot *deque_at(const deque *d, size_t i);
+void *deque_front(const deque *d);
+void *deque_back(const deque *d);
+void deque_clear(deque *d);
+void deque_destroy(deque *d);
+
+/* d-ary heap priority queue */
+#define HEAP_ARITY 4
+#define HEAP_MIN_CAPACITY 16
+
+typedef deque_slot heap_slot;
+typedef struct __heap__ {
+	heap_slot *slots;
+	size_t size;
+	size_t cap;
+	unsigned int arity;
+	int (*compare)(const void *a, const void *b);
+	void (*destroy)(void *d);
+	const xallocator *allocator;
+} heap;
+
+#define heap_size(h) ((h)->size)
+heap *heap_init(unsigned int arity, int (*compare)(const void *a, const void *b));
+heap *heap_init_a(const xallocator *a, unsigned int arity, int (*compare)(const void *a, const void *b));
+int heap_push(heap *h, void *data, unsigned short type, unsigned short memory_type);
+void *heap_peek(const heap *h);
+void *heap_pop(heap *h);
+void heap_clear(heap *h);
+void heap_destroy(heap *h);
+
 /* vector */
 typedef list_element vector_element;
 typedef struct __vector__ {
@@ -179,6 +679,7 @@ typedef struct __vector__ {
 } vector;
 
 vector *vector_init(unsigned short type, unsigned short memory_type);
+vector *vector_init_a(const xallocator *a, unsigned short type, unsigned short memory_type);
 #define vector_size(v) (v->list->size)
 #define vector_insert_before(v, before, data) list_insert_before(v->list, before, data, v->type, v->memory_type)
 #define vector_insert_after(v, after, data) list_insert_after(v->list, after, data, v->type, v->memory_type)
@@ -188,7 +689,7 @@ vector *vector_init(unsigned short type, unsigned short memory_type);
 #define vector_current(v) list_current(v->list)
 #define vector_clear(v) list_clear(v->list)
 #define vector_remove_element(v, e) list_remove_element(v->list, e)
-#define vector_destroy(v) if (v != NULL) { list_destroy(v->list); free(v); v = NULL; }
+#define vector_destroy(v) if (v != NULL) { const xallocator *_va = v->list->allocator; list_destroy(v->list); xalloc_free(_va, v); v = NULL; }
 #define vector_print(v) list_print(v->list)
 #define vector_free_element_data(e) list_free_element_data(e)
 #define vector_rewind(v) list_rewind(v->list)
@@ -201,11 +702,154 @@ vector *vector_init(unsigned short type, unsigned short memory_type);
 		vector_remove_element(va, e);   \
 	}
 
+/* parallel vector operations, run over chunks on xpool_default() */
+enum vector_reduce_ops {
+	VECTOR_SUM = 1,
+	VECTOR_MIN,
+	VECTOR_MAX,
+};
+
+#define VECTOR_PARALLEL_CHUNK 4096 /* smallest chunk handed to another thread */
+
+int vector_map(vector *v, long double (*fn)(long double x, void *arg), void *arg);
+int vector_reduce(vector *v, unsigned short op, long double *result);
+int vector_foreach_parallel(vector *v, void (*fn)(vector_element *e, void *arg), void *arg);
+vector *vector_filter(vector *v, int (*keep)(vector_element *e, void *arg), void *arg);
+
+/*
+ * Typed vectors holding their values inline in one array, generated per use:
+ *
+ *     VECTOR_DEFINE_NUMERIC(doubles, double, double)
+ *     doubles d;
+ *     doubles_init(&d, 0);
+ *     doubles_push(&d, 1.5);
+ *     double total = doubles_sum(&d);
+ *
+ * VECTOR_DEFINE works for any T; VECTOR_DEFINE_NUMERIC adds sum, min, max
+ * and find for arithmetic T, summing into SUM_T. Their loops are written
+ * so the compiler can vectorise them.
+ */
+#define VECTOR_MIN_CAPACITY 8
+
+#define VECTOR_DEFINE(name, T) \
+typedef struct __##name##__ { \
+	T *data; \
+	size_t size; \
+	size_t cap; \
+} name; \
+\
+/* room for n values without growing */ \
+static inline int name##_reserve(name *v, size_t n) { \
+	size_t cap = v->cap > 0 ? v->cap : VECTOR_MIN_CAPACITY; \
+	T *data; \
+	if (n <= v->cap) return 1; \
+	while (cap < n) cap <<= 1; \
+	if ((data = (T *)realloc(v->data, cap * sizeof(T))) == NULL) return 0; \
+	v->data = data; \
+	v->cap = cap; \
+	return 1; \
+} \
+\
+static inline int name##_init(name *v, size_t n) { \
+	v->data = NULL; \
+	v->size = 0; \
+	v->cap = 0; \
+	return name##_reserve(v, n); \
+} \
+\
+static inline void name##_destroy(name *v) { \
+	free(v->data); \
+	v->data = NULL; \
+	v->size = v->cap = 0; \
+} \
+\
+static inline void name##_clear(name *v) { \
+	v->size = 0; \
+} \
+\
+static inline int name##_push(name *v, T value) { \
+	if (v->size == v->cap && !name##_reserve(v, v->size + 1)) return 0; \
+	v->data[v->size++] = value; \
+	return 1; \
+} \
+\
+/* 0 when empty */ \
+static inline int name##_pop(name *v, T *out) { \
+	if (v->size == 0) return 0; \
+	v->size--; \
+	if (out != NULL) *out = v->data[v->size]; \
+	return 1; \
+} \
+\
+/* NULL when i is out of range */ \
+static inline T *name##_at(const name *v, size_t i) { \
+	return i < v->size ? &v->data[i] : NULL; \
+} \
+\
+/* sets every value, growing the vector to n first */ \
+static inline int name##_fill(name *v, size_t n, T value) { \
+	T *data; \
+	size_t i; \
+	if (!name##_reserve(v, n)) return 0; \
+	for (data = v->data, i = 0; i < n; i++) data[i] = value; \
+	v->size = n; \
+	return 1; \
+}
+
+#define VECTOR_DEFINE_NUMERIC(name, T, SUM_T) \
+VECTOR_DEFINE(name, T) \
+\
+static inline SUM_T name##_sum(const name *v) { \
+	const T *data = v->data; \
+	SUM_T s0 = 0, s1 = 0, s2 = 0, s3 = 0; \
+	size_t i, n = v->size; \
+	/* independent accumulators keep the adds from serialising */ \
+	for (i = 0; i + 4 <= n; i += 4) { \
+		s0 += data[i]; \
+		s1 += data[i + 1]; \
+		s2 += data[i + 2]; \
+		s3 += data[i + 3]; \
+	} \
+	for (; i < n; i++) s0 += data[i]; \
+	return (s0 + s1) + (s2 + s3); \
+} \
+\
+/* 0 when empty */ \
+static inline int name##_min(const name *v, T *out) { \
+	const T *data = v->data; \
+	T m; \
+	size_t i; \
+	if (v->size == 0) return 0; \
+	for (m = data[0], i = 1; i < v->size; i++) m = data[i] < m ? data[i] : m; \
+	*out = m; \
+	return 1; \
+} \
+\
+static inline int name##_max(const name *v, T *out) { \
+	const T *data = v->data; \
+	T m; \
+	size_t i; \
+	if (v->size == 0) return 0; \
+	for (m = data[0], i = 1; i < v->size; i++) m = data[i] > m ? data[i] : m; \
+	*out = m; \
+	return 1; \
+} \
+\
+/* index of the first value equal to value, -1 if none */ \
+static inline long name##_find(const name *v, T value) { \
+	const T *data = v->data; \
+	size_t i; \
+	for (i = 0; i < v->size; i++) \
+		if (data[i] == value) return (long)i; \
+	return -1; \
+}
+
 #define HASHSIZE 256
+#define HASH_BATCH 16          /* lookups hash_get_many() keeps in flight */
 
 typedef struct __hashtab__ {
 	struct __hashtab__ *next;
-	char key[NAME_MAX];
+	const char *key;       /* keybuf, or the pool's copy for interned keys */
 	void *val;
 	unsigned short type;
 	// a pointer to function to free memory of val
@@ -213,16 +857,348 @@ typedef struct __hashtab__ {
 	// function to handle the destruction of memory
 	void (*destroy)(void *v);
 	void (*print)(void *v);
+	const xallocator *allocator;
+	char keybuf[];         /* sized to the key */
 } hashtab;
 
 unsigned int hash(const char *s);
+unsigned int hash_bytes(const void *data, size_t len);
+uint64_t hash_bytes64(const void *data, size_t len);
 void hash_init(hashtab *h[]);
 hashtab *hash_get(hashtab *h[], const char *key);
 hashtab *hash_set(hashtab *h[], const char *key, void *val, unsigned short type, void (*destroy)(void *v), void (*print)(void *v));
+hashtab *hash_set_a(const xallocator *a, hashtab *h[], const char *key, void *val, unsigned short type, void (*destroy)(void *v), void (*print)(void *v));
+hashtab *hash_get_interned(hashtab *h[], const char *ikey);
+size_t hash_get_many(hashtab *h[], const char *const keys[], size_t n, hashtab *out[]);
+hashtab *hash_set_interned(hashtab *h[], const char *ikey, void *val, unsigned short type, void (*destroy)(void *v), void (*print)(void *v));
 void hash_unset(hashtab *h[], const char *key);
 void hash_destroy(hashtab *h[], unsigned int size);
 void hash_print(hashtab *h[], unsigned int size);
 
+/* bounded LRU cache with per-entry TTL */
+#define HASH_CACHE_MIN_BUCKETS 64
+
+typedef struct __hash_cache_entry__ {
+	struct __hash_cache_entry__ *next;   /* bucket chain */
+	struct __hash_cache_entry__ *newer;  /* recency list */
+	struct __hash_cache_entry__ *older;
+	void *val;
+	unsigned short type;
+	void (*destroy)(void *v);
+	unsigned int hashval;
+	size_t key_len;
+	size_t bytes;          /* charged against max_bytes */
+	long long expires;     /* CLOCK_MONOTONIC milliseconds, 0 never */
+	char key[];
+} hash_cache_entry;
+
+typedef struct __hash_cache__ {
+	hash_cache_entry **buckets;
+	size_t nbuckets;
+	hash_cache_entry *newest;
+	hash_cache_entry *oldest;
+	size_t size;
+	size_t max_entries;    /* 0 for no limit */
+	size_t bytes;
+	size_t max_bytes;      /* 0 for no limit */
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long evictions;
+	unsigned long long expirations;
+	const xallocator *allocator;
+} hash_cache;
+
+hash_cache *hash_cache_init(size_t max_entries, size_t max_bytes);
+hash_cache *hash_cache_init_a(const xallocator *a, size_t max_entries, size_t max_bytes);
+hash_cache_entry *hash_cache_get(hash_cache *c, const char *key);
+hash_cache_entry *hash_cache_set(hash_cache *c, const char *key, void *val, unsigned short type, void (*destroy)(void *v), size_t bytes, long long ttl_ms);
+int hash_cache_unset(hash_cache *c, const char *key);
+size_t hash_cache_purge(hash_cache *c);
+void hash_cache_clear(hash_cache *c);
+void hash_cache_destroy(hash_cache *c);
+
+/* serialize */
+#define XWRITER_CHUNK_SIZE (64 * KB)
+
+enum xserial_flags {
+	XSERIAL_JSON = 0,
+	XSERIAL_NDJSON = 1,          /* one value (or one {"key": value}) per line */
+	XSERIAL_PRINT_CALLBACKS = 2, /* call element print callbacks when writing to stdout */
+};
+
+typedef struct __xwriter__ {
+	char *buf;
+	size_t len;
+	size_t cap;            /* the chunk size, or the current size of a memory writer */
+	int fd;                /* -1 unless writing to a file descriptor */
+	int (*sink)(const char *data, size_t len, void *arg);
+	void *arg;
+	unsigned char error;
+	unsigned char grow;    /* memory writer */
+} xwriter;
+
+void xwriter_mem(xwriter *w);
+void xwriter_fd(xwriter *w, int fd, size_t chunk);
+void xwriter_sink(xwriter *w, int (*sink)(const char *data, size_t len, void *arg), void *arg, size_t chunk);
+void xwriter_write(xwriter *w, const char *data, size_t len);
+void xwriter_putc(xwriter *w, char c);
+void xwriter_string(xwriter *w, const char *s, size_t len);
+void xwriter_int(xwriter *w, long long v);
+void xwriter_uint(xwriter *w, unsigned long long v);
+void xwriter_double(xwriter *w, long double v, int digits);
+int xwriter_flush(xwriter *w);
+int xwriter_close(xwriter *w);
+int list_serialize(xwriter *w, list *l, unsigned short flags);
+int hash_serialize(xwriter *w, hashtab *h[], unsigned int size, unsigned short flags);
+#define vector_serialize(w, v, flags) list_serialize(w, (v)->list, flags)
+
+/*
+ * Binary vector files: a 64 byte header followed by the packed values in
+ * native byte order, so a mapped file can be used in place.
+ */
+#define XVEC_MAGIC "XSTDVEC"
+#define XVEC_VERSION 1
+#define XVEC_HEADER_SIZE 64
+
+typedef struct __xvec_header__ {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;   /* 0x01020304 as written by the saving machine */
+	uint16_t type;         /* enum __types__ */
+	uint16_t elem_size;
+	uint32_t reserved;
+	uint64_t count;
+	uint64_t payload;      /* offset of the first value, XVEC_HEADER_SIZE */
+	char pad[XVEC_HEADER_SIZE - 40];
+} xvec_header;
+
+typedef struct __vector_view__ {
+	unsigned short type;
+	size_t elem_size;
+	size_t count;
+	const void *data;      /* count packed values, read-only */
+	void *map;
+	size_t map_len;
+} vector_view;
+
+int vector_save(vector *v, const char *path);
+vector *vector_load(const char *path);
+int vector_map_file(const char *path, vector_view *view);
+void vector_unmap(vector_view *view);
+
+/* blocked Bloom filters */
+#define BLOOM_BLOCK_BITS 512   /* one cache line */
+#define BLOOM_MAX_K 16
+#define XBLOOM_MAGIC "XSTDBLM"
+#define XBLOOM_VERSION 1
+
+typedef struct __bloom__ {
+	uint64_t *bits;        /* nblocks blocks, cache line aligned */
+	size_t nblocks;
+	unsigned int k;        /* bits set per key */
+	size_t count;          /* keys added */
+	void *mem;             /* the allocation bits points into */
+	const xallocator *allocator;
+} bloom;
+
+typedef struct __xbloom_header__ {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;   /* 0x01020304 as written by the saving machine */
+	uint32_t k;
+	uint32_t reserved;
+	uint64_t nblocks;
+	uint64_t count;
+	char pad[24];
+} xbloom_header;
+
+bloom *bloom_init(size_t expected, double fp_rate);
+bloom *bloom_init_a(const xallocator *a, size_t expected, double fp_rate);
+void bloom_add(bloom *b, const void *key, size_t len);
+int bloom_test(const bloom *b, const void *key, size_t len);
+void bloom_add_hash(bloom *b, uint64_t h);
+int bloom_test_hash(const bloom *b, uint64_t h);
+void bloom_add_many(bloom *b, const char *const *keys, size_t n);
+size_t bloom_test_many(const bloom *b, const char *const *keys, size_t n, unsigned char *results);
+void bloom_clear(bloom *b);
+void bloom_destroy(bloom *b);
+int bloom_write(const bloom *b, xwriter *w);
+bloom *bloom_read(const void *data, size_t len);
+int bloom_save(const bloom *b, const char *path);
+bloom *bloom_load(const char *path);
+bloom *hash_bloom(hashtab *h[], unsigned int size, double fp_rate);
+hashtab *hash_get_filtered(const bloom *f, hashtab *h[], const char *key);
+hashtab *hash_set_filtered(bloom *f, hashtab *h[], const char *key, void *val, unsigned short type, void (*destroy)(void *v), void (*print)(void *v));
+
+/*
+ * Typed hash tables with integer or pointer keys, generated per use:
+ *
+ *     HASH_DEFINE_INT64(user_index, struct user *)
+ *     user_index ids;
+ *     user_index_init(&ids, 0);
+ *     user_index_set(&ids, 42, u);
+ *     struct user **found = user_index_get(&ids, 42);
+ *
+ * Keys and values sit inline in one open-addressed array probed linearly
+ * from a Fibonacci (multiplicative) hash, so a lookup touches one or two
+ * cache lines. Deletion shifts the following run back, no tombstones.
+ * Pointers returned by _get and _next are valid until the next _set or
+ * _unset.
+ */
+#define HASH_FIBONACCI 11400714819323198485ULL
+#define HASH_MIN_CAPACITY 8
+#define HASH_INT_KEY(k) ((uint64_t)(k))
+#define HASH_PTR_KEY(k) ((uint64_t)(uintptr_t)(k))
+
+#define HASH_DEFINE(name, K, V, KEY_BITS) \
+typedef struct __##name##_slot__ { \
+	K key; \
+	V val; \
+	unsigned char used; \
+} name##_slot; \
+\
+typedef struct __##name##__ { \
+	name##_slot *slots; \
+	size_t size; \
+	size_t cap;            /* a power of two */ \
+	unsigned int shift;    /* 64 - log2(cap) */ \
+} name; \
+\
+static inline size_t name##_home(const name *h, K key) { \
+	return (size_t)((KEY_BITS(key) * HASH_FIBONACCI) >> h->shift); \
+} \
+\
+static inline int name##_rehash(name *h, size_t cap) { \
+	name##_slot *old = h->slots, *slots; \
+	size_t old_cap = h->cap, i, j; \
+	unsigned int shift = 64; \
+	if ((slots = (name##_slot *)calloc(cap, sizeof(name##_slot))) == NULL) return 0; \
+	for (i = cap; i > 1; i >>= 1) shift--; \
+	h->slots = slots; \
+	h->cap = cap; \
+	h->shift = shift; \
+	for (i = 0; i < old_cap; i++) { \
+		if (!old[i].used) continue; \
+		for (j = name##_home(h, old[i].key); slots[j].used; j = (j + 1) & (cap - 1)); \
+		slots[j] = old[i]; \
+	} \
+	free(old); \
+	return 1; \
+} \
+\
+/* room for n keys without growing */ \
+static inline int name##_reserve(name *h, size_t n) { \
+	size_t cap = h->cap > 0 ? h->cap : HASH_MIN_CAPACITY; \
+	/* past this the doubling below would wrap to 0 */ \
+	if (n > (SIZE_MAX / 2 + 1) / 4 * 3) return 0; \
+	while (n > cap / 4 * 3) cap <<= 1; \
+	return cap == h->cap || name##_rehash(h, cap); \
+} \
+\
+static inline int name##_init(name *h, size_t n) { \
+	h->slots = NULL; \
+	h->size = 0; \
+	h->cap = 0; \
+	h->shift = 64; \
+	return name##_reserve(h, n); \
+} \
+\
+static inline void name##_destroy(name *h) { \
+	free(h->slots); \
+	h->slots = NULL; \
+	h->size = h->cap = 0; \
+} \
+\
+/* NULL when absent, also on a destroyed or failed table */ \
+static inline V *name##_get(const name *h, K key) { \
+	size_t i; \
+	if (h->cap == 0) return NULL; \
+	for (i = name##_home(h, key); h->slots[i].used; i = (i + 1) & (h->cap - 1)) \
+		if (h->slots[i].key == key) return &h->slots[i].val; \
+	return NULL; \
+} \
+\
+/* inserts or replaces, 0 when out of memory */ \
+static inline int name##_set(name *h, K key, V val) { \
+	size_t i; \
+	if (!name##_reserve(h, h->size + 1)) return 0; \
+	for (i = name##_home(h, key); h->slots[i].used; i = (i + 1) & (h->cap - 1)) { \
+		if (h->slots[i].key == key) { h->slots[i].val = val; return 1; } \
+	} \
+	h->slots[i].key = key; \
+	h->slots[i].val = val; \
+	h->slots[i].used = 1; \
+	h->size++; \
+	return 1; \
+} \
+\
+/* 1 if the key was there */ \
+static inline int name##_unset(name *h, K key) { \
+	size_t mask = h->cap - 1, i, j, k; \
+	if (h->cap == 0) return 0; \
+	for (i = name##_home(h, key); h->slots[i].used; i = (i + 1) & mask) \
+		if (h->slots[i].key == key) break; \
+	if (!h->slots[i].used) return 0; \
+	for (j = i;;) { \
+		j = (j + 1) & mask; \
+		if (!h->slots[j].used) break; \
+		k = name##_home(h, h->slots[j].key); \
+		/* move it back unless its home lies cyclically in (i, j] */ \
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) continue; \
+		h->slots[i] = h->slots[j]; \
+		i = j; \
+	} \
+	h->slots[i].used = 0; \
+	h->size--; \
+	return 1; \
+} \
+\
+/* walks the entries, start *pos at 0 */ \
+static inline name##_slot *name##_next(const name *h, size_t *pos) { \
+	while (*pos < h->cap) \
+		if (h->slots[(*pos)++].used) return &h->slots[*pos - 1]; \
+	return NULL; \
+}
+
+#define HASH_DEFINE_INT64(name, V) HASH_DEFINE(name, int64_t, V, HASH_INT_KEY)
+#define HASH_DEFINE_UINT64(name, V) HASH_DEFINE(name, uint64_t, V, HASH_INT_KEY)
+#define HASH_DEFINE_PTR(name, V) HASH_DEFINE(name, const void *, V, HASH_PTR_KEY)
+
+/*
+ * Inline fast paths. With GCC/Clang these bodies are only used for inlining
+ * into the caller. strings.c defines XSTDLIB_INLINE empty before including
+ * this header, which turns them into the library's out-of-line copies.
+ * Define XSTDLIB_NO_INLINE to always call into the library.
+ */
+#if !defined(XSTDLIB_INLINE) && defined(__GNUC__) && !defined(XSTDLIB_NO_INLINE)
+#define XSTDLIB_INLINE extern __inline__ __attribute__((__gnu_inline__))
+#endif
+
+#ifdef XSTDLIB_INLINE
+/**
+ * Checks whether a character is a valid ascii printable character codes 32-126
+ * Returns true if the character is valid, false if not valid.
+ */
+XSTDLIB_INLINE unsigned char is_ascii_pchar(char c) {
+	return c >= 32 && c <= 126;
+}
+
+/**
+ * Converts a character that "is" a number to its real data type
+ * an integer
+ */
+XSTDLIB_INLINE int ctoi(unsigned char c) {
+	return c >= '0' && c <= '9' ? c - '0' : -1;
+}
+
+XSTDLIB_INLINE unsigned int hash(const char *s) {
+	unsigned int hashval;
+	for (hashval = 0; *s != '\0'; s++)
+		hashval = *s + 31 * hashval;
+	return hashval % HASHSIZE;
+}
+#endif
+
 #ifdef __cplusplus
 }
 #endif